@@ -8,6 +8,7 @@
  */
 
 #include <Eigen/Core>
+#include <Eigen/Geometry>
 #include <utility>
 
 USING_PART_OF_NAMESPACE_EIGEN ; ///< Using namespace Eigen
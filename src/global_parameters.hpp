@@ -20,7 +20,7 @@
 
 class GlobalParameters {
 private :
-    GlobalParameters() : _res_x(800), _res_y(600), _supersampling(false), _nb_photon_MAX(10000), _nb_photon_to_find(100), _photon_depth(20), _raytracer_depth(3) {} ///< Constructor
+    GlobalParameters() : _res_x(800), _res_y(600), _supersampling(false), _nb_photon_MAX(10000), _nb_photon_to_find(100), _max_search_radius(0.0), _nb_caustic_photon_MAX(0), _nb_caustic_photon_to_find(50), _direct_lighting(true), _shadow_rays(16), _final_gather_rays(0), _irradiance_cache_accuracy(0.2), _irradiance_photon_step(0), _progressive_passes(0), _photon_depth(20), _raytracer_depth(3), _threads(0), _seed(0) {} ///< Constructor
     ~GlobalParameters() {} ///< Destructor
 
 public :
@@ -29,16 +29,38 @@ public :
     void set_supersampling(bool supersampling) {_supersampling = supersampling;} ///< Sets whether the anti-aliasing (supersampling) solution will be used or not
     void set_nb_photon_MAX(int nb_photon_MAX) {_nb_photon_MAX = nb_photon_MAX;} ///< Sets the maximum number of divisions (reflection/refraction) of rays
     void set_nb_photon_to_find(int nb_photon_to_find) {_nb_photon_to_find = nb_photon_to_find;} ///< Sets the maximum number of photons to look for
+    void set_max_search_radius(double max_search_radius) {_max_search_radius = max_search_radius;} ///< Sets the radius beyond which photons are not looked for (0 for no limit)
+    void set_nb_caustic_photon_MAX(int nb_caustic_photon_MAX) {_nb_caustic_photon_MAX = nb_caustic_photon_MAX;} ///< Sets the number of photons emitted for the caustic map (0 for no caustic map)
+    void set_nb_caustic_photon_to_find(int nb_caustic_photon_to_find) {_nb_caustic_photon_to_find = nb_caustic_photon_to_find;} ///< Sets the maximum number of caustic photons to look for
+    void set_direct_lighting(bool direct_lighting) {_direct_lighting = direct_lighting;} ///< Sets whether the light coming straight from the sources is traced with shadow rays rather than photons
+    void set_shadow_rays(int shadow_rays) {_shadow_rays = shadow_rays;} ///< Sets the number of shadow rays towards each radiant volume
+    void set_final_gather_rays(int final_gather_rays) {_final_gather_rays = final_gather_rays;} ///< Sets the number of rays of each final gathering (0 for no final gathering)
+    void set_irradiance_cache_accuracy(double irradiance_cache_accuracy) {_irradiance_cache_accuracy = irradiance_cache_accuracy;} ///< Sets the error allowed when interpolating the final gatherings (0 to gather at each point)
+    void set_irradiance_photon_step(int irradiance_photon_step) {_irradiance_photon_step = irradiance_photon_step;} ///< Sets one photon out of how many carries a precomputed irradiance (0 for no precomputation)
+    void set_progressive_passes(int progressive_passes) {_progressive_passes = progressive_passes;} ///< Sets the number of photon passes of the progressive photon mapping (0 for a single photon map)
     void set_photon_depth(int photon_depth) {_photon_depth = photon_depth;} ///< Sets the maximum number of photons emitted during the photon-mapping
     void set_raytracer_depth(int raytracer_depth) {_raytracer_depth = raytracer_depth;} ///< Sets the maximum number of reflection/refraction of photons
+    void set_threads(int threads) {_threads = threads;} ///< Sets the number of rendering threads (0 for one per hardware thread)
+    void set_seed(unsigned int seed) {_seed = seed;} ///< Sets the seed of the random generators of the photons
 
     int get_res_x () {return _res_x;} ///< Returns the resolution component X
     int get_res_y () {return _res_y;} ///< Returns the resolution component Y
     bool get_supersampling () {return _supersampling;} ///< Returns whether the anti-aliasing (supersampling) solution will be used or not
     int get_nb_photon_MAX () {return _nb_photon_MAX;} ///< Returns the maximum number of photons emitted during the photon-mapping
     int get_nb_photon_to_find () {return _nb_photon_to_find;} ///< Returns the maximum number of photons to look for (indirect illumination)
+    double get_max_search_radius () {return _max_search_radius;} ///< Returns the radius beyond which photons are not looked for (0 for no limit)
+    int get_nb_caustic_photon_MAX () {return _nb_caustic_photon_MAX;} ///< Returns the number of photons emitted for the caustic map (0 for no caustic map)
+    int get_nb_caustic_photon_to_find () {return _nb_caustic_photon_to_find;} ///< Returns the maximum number of caustic photons to look for
+    bool get_direct_lighting () {return _direct_lighting;} ///< Returns whether the light coming straight from the sources is traced with shadow rays rather than photons
+    int get_shadow_rays () {return _shadow_rays;} ///< Returns the number of shadow rays towards each radiant volume
+    int get_final_gather_rays () {return _final_gather_rays;} ///< Returns the number of rays of each final gathering (0 for no final gathering)
+    double get_irradiance_cache_accuracy () {return _irradiance_cache_accuracy;} ///< Returns the error allowed when interpolating the final gatherings (0 to gather at each point)
+    int get_irradiance_photon_step () {return _irradiance_photon_step;} ///< Returns one photon out of how many carries a precomputed irradiance (0 for no precomputation)
+    int get_progressive_passes () {return _progressive_passes;} ///< Returns the number of photon passes of the progressive photon mapping (0 for a single photon map)
     int get_photon_depth () {return _photon_depth;} ///< Returns the maximum number of reflection/refraction of photons
     int get_raytracer_depth () {return _raytracer_depth;} ///< Returns the maximum number of divisions (reflection/refraction) of rays
+    int get_threads () {return _threads;} ///< Returns the number of rendering threads (0 for one per hardware thread)
+    unsigned int get_seed () {return _seed;} ///< Returns the seed of the random generators of the photons
 
     static GlobalParameters * get_unique_instance() { ///< Gives the unique instance of the class
         if (_unique_instance == 0)
@@ -53,8 +75,19 @@ private :
     bool    _supersampling; ///< Will supersampling antialiasing be used?
     int     _nb_photon_MAX; ///< Maximum number
     int		_nb_photon_to_find; ///< Number of photons searched in PhotonMapper::get_k_nearest_photons
+    double  _max_search_radius; ///< Radius beyond which photons are not looked for (0 for no limit)
+    int     _nb_caustic_photon_MAX; ///< Number of photons emitted for the caustic map (0 for no caustic map)
+    int     _nb_caustic_photon_to_find; ///< Number of caustic photons searched for each estimate
+    bool    _direct_lighting; ///< Is the light coming straight from the sources traced with shadow rays?
+    int     _shadow_rays; ///< Number of shadow rays towards each radiant volume
+    int     _final_gather_rays; ///< Number of rays of each final gathering (0 for no final gathering)
+    double  _irradiance_cache_accuracy; ///< Error allowed when interpolating the final gatherings (0 to gather at each point)
+    int     _irradiance_photon_step; ///< One photon out of this number carries a precomputed irradiance (0 for no precomputation)
+    int     _progressive_passes; ///< Number of photon passes of the progressive photon mapping (0 for a single photon map)
     int     _photon_depth; ///< Maximum number of reflection/refraction of photons
     int     _raytracer_depth; ///< Maximum number of divisions (reflection/refraction) of rays
+    int     _threads; ///< Number of rendering threads (0 for one per hardware thread)
+    unsigned int _seed; ///< Seed of the random generators of the photons
 
     static GlobalParameters * _unique_instance; ///< Pointer to the unique instance of the class
 };
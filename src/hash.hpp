@@ -0,0 +1,44 @@
+#ifndef HASH_HPP_
+#define HASH_HPP_
+
+/**
+ * \file hash.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of the FNV-1a hash functions
+ */
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+static const uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL ; ///< Hash of nothing, first value to give to fnv1a()
+
+/**
+ * \brief Hashes bytes (64 bits FNV-1a)
+ * \param data : the bytes to hash
+ * \param size : the number of bytes
+ * \param hash : the hash of what was hashed before, to chain calls
+ */
+inline uint64_t fnv1a(const void *data, std::size_t size, uint64_t hash = FNV_OFFSET_BASIS)
+{
+	const unsigned char *bytes = (const unsigned char *)data ;
+	for (std::size_t i = 0; i < size; i++) {
+		hash ^= bytes[i] ;
+		hash *= 1099511628211ULL ;
+	}
+	return hash ;
+}
+
+/**
+ * \brief Hashes a string, its size included so that chained strings can not be confused
+ * \param str : the string to hash
+ * \param hash : the hash of what was hashed before
+ */
+inline uint64_t fnv1a(const std::string& str, uint64_t hash = FNV_OFFSET_BASIS)
+{
+	uint64_t size = str.size() ;
+	hash = fnv1a(&size, sizeof(size), hash) ;
+	return fnv1a(str.data(), str.size(), hash) ;
+}
+
+#endif /* HASH_HPP_ */
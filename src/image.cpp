@@ -4,70 +4,184 @@
  * \author B.BORGOBELLO
  */
 
+#include <algorithm>
+#include <cstdlib>
 #include "image.hpp"
 
 using std::string ;
-using boost::shared_ptr ;
+using std::vector ;
+
+/**
+ * \brief Reads a whole TGA file, exits if it can not be used
+ * \param filename : the name of the file
+ * \param data : filled with the content of the file
+ */
+static void read_whole_file(const std::string& filename, vector<unsigned char>& data)
+{
+    std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!stream) {
+        std::cout << std::endl << "Can't read the TGA file " << filename << " or doesn't exists" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    stream.seekg(0, std::ios::end);
+    std::streamoff size = stream.tellg();
+    stream.seekg(0, std::ios::beg);
+
+    data.resize(size);
+    if (size > 0) stream.read((char *)&data[0], size);
+    if (!stream) {
+        std::cout << std::endl << "Can't read the TGA file " << filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * \brief Decompresses the pixels of a run-length encoded TGA
+ * \param src, src_end : the compressed pixels
+ * \param bytes_per_pixel : size of a pixel
+ * \param dst : receives the pixels, must be already sized
+ *
+ * Returns false if the compressed data ends too early
+ */
+static bool rle_decode(const unsigned char *src, const unsigned char *src_end, int bytes_per_pixel, vector<unsigned char>& dst)
+{
+    unsigned char *out = &dst[0];
+    unsigned char *out_end = out + dst.size();
+
+    while (out < out_end) {
+        if (src >= src_end) return false;
+        int count = (*src & 0x7F) + 1;
+        bool run = (*src & 0x80) != 0;
+        src++;
+
+        int nb_bytes = count * bytes_per_pixel;
+        if (out + nb_bytes > out_end) nb_bytes = out_end - out;
+
+        if (run) {
+            if (src + bytes_per_pixel > src_end) return false;
+            for (int k = 0; k < nb_bytes; k++)
+                out[k] = src[k % bytes_per_pixel];
+            src += bytes_per_pixel;
+        }
+        else {
+            if (src + nb_bytes > src_end) return false;
+            std::copy(src, src + nb_bytes, out);
+            src += nb_bytes;
+        }
+        out += nb_bytes;
+    }
+    return true;
+}
+
+/**
+ * \brief Compresses one scanline of 24 bits pixels
+ * \param row : the pixels (blue, green, red)
+ * \param width : number of pixels
+ * \param out : the compressed packets are appended to it
+ *
+ * Packets never cross scanlines, as the format asks
+ */
+static void rle_encode_row(const unsigned char *row, int width, vector<unsigned char>& out)
+{
+    int i = 0;
+    while (i < width) {
+        const unsigned char *pixel = row + 3*i;
+        int run = 1;
+        while (i + run < width && run < 128
+               && pixel[3*run] == pixel[0] && pixel[3*run+1] == pixel[1] && pixel[3*run+2] == pixel[2])
+            run++;
+
+        if (run > 1) {
+            out.push_back(0x80 | (run - 1));
+            out.insert(out.end(), pixel, pixel + 3);
+            i += run;
+        }
+        else {
+            // Raw packet up to the start of the next run
+            int count = 0;
+            while (i + count < width && count < 128) {
+                const unsigned char *p = row + 3*(i + count);
+                if (i + count + 1 < width && p[3] == p[0] && p[4] == p[1] && p[5] == p[2]) break;
+                count++;
+            }
+            out.push_back(count - 1);
+            out.insert(out.end(), pixel, pixel + 3*count);
+            i += count;
+        }
+    }
+}
 
 /**
  * \param filename : the name of the .TGA file to import
  * into the project (for Bitmap textures)
  *
  * This function creates an Image, which is the representation
- * of a .TGA file with a matrix of pixels
+ * of a .TGA file with a matrix of pixels.
+ * The whole file is read at once, then decoded. Handles true-color
+ * images (24 or 32 bits) either raw (type 2) or run-length encoded (type 10)
  */
 Image::Image(const std::string filename) {
     using namespace std;
 
-    std::ifstream stream;
-    stream.open(filename.c_str());
-    if (!stream) {
-        std::cout << std::endl << "Can't read the TGA file " << filename << " or doesn't exists" << std::endl;
+    vector<unsigned char> file;
+    read_whole_file(filename, file);
+
+    if (file.size() < 18) {
+        cout << endl << "The TGA file " << filename << " is truncated" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    int id_length = file[0];
+    int colormap_type = file[1];
+    int image_type = file[2];
+    int colormap_length = file[5] + 256*file[6];
+    int colormap_entry_bits = file[7];
+    _res_x = file[12] + 256*file[13];
+    _res_y = file[14] + 256*file[15];
+    int bytes_per_pixel = file[16] / 8;
+    bool top_to_bottom = (file[17] & 0x20) != 0;
+
+    if ((image_type != 2 && image_type != 10) || (bytes_per_pixel != 3 && bytes_per_pixel != 4)) {
+        cout << endl << "The TGA file " << filename << " is not a 24 or 32 bits true-color image" << endl;
         exit(EXIT_FAILURE);
     }
+
+    unsigned int offset = 18 + id_length;
+    if (colormap_type != 0) offset += colormap_length * ((colormap_entry_bits + 7) / 8);
+
+    // Pixels in the order of the file
+    vector<unsigned char> raw(_res_x * _res_y * bytes_per_pixel);
+    bool complete;
+    if (offset > file.size())
+        complete = raw.empty();
+    else if (image_type == 10)
+        complete = rle_decode(&file[0] + offset, &file[0] + file.size(), bytes_per_pixel, raw);
     else {
-        unsigned int size_x=0;
-        unsigned int size_y=0;
-        char car;
-        unsigned char ucar;
-
-        stream.seekg(12);
-
-        stream.get(car);
-        ucar = car;
-        size_x += ucar;
-        stream.get(car);
-        ucar = car;
-        size_x += ucar*256;
-
-        stream.get(car);
-        ucar = car;
-        size_y += ucar;
-        stream.get(car);
-        ucar = car;
-        size_y += ucar*256;
-
-        stream.get(car);
-        stream.get(car);
-
-        _res_x = size_x;
-        _res_y = size_y;
-
-        _matrix.resize(_res_x);
-        for (int i = 0; i < _res_x; i++)
-            _matrix.at(i).resize(_res_y);
-
-        char r,g,b;
-        boost::shared_ptr<Color> col;
-        for (int j=_res_y-1; j >= 0 ; j--) {
-            for (int i=0 ; i <_res_x; i++) {
-                stream.get(b);
-                stream.get(g);
-                stream.get(r);
-                _matrix[i][j] = col = boost::shared_ptr<Color>(new Color( (double)((unsigned char)r)/255.0 ,(double)((unsigned char)g)/255.0 ,(double)((unsigned char)b)/255.0));
-            }
+        complete = (file.size() - offset >= raw.size());
+        if (complete && !raw.empty()) std::copy(file.begin() + offset, file.begin() + offset + raw.size(), raw.begin());
+    }
+    if (!complete) {
+        cout << endl << "The TGA file " << filename << " is truncated" << endl;
+        exit(EXIT_FAILURE);
+    }
+
+    // Converting to floats, the bottom row comes first unless told otherwise
+    float to_float[256];
+    for (int k = 0; k < 256; k++)
+        to_float[k] = k / 255.0f;
+
+    _pixels.resize(3 * _res_x * _res_y);
+    for (int row = 0; row < _res_y; row++) {
+        int j = top_to_bottom ? row : _res_y - 1 - row;
+        const unsigned char *src = &raw[row * _res_x * bytes_per_pixel];
+        float *dst = &_pixels[3 * j * _res_x];
+        for (int i = 0; i < _res_x; i++) {
+            dst[3*i] = to_float[src[2]];
+            dst[3*i+1] = to_float[src[1]];
+            dst[3*i+2] = to_float[src[0]];
+            src += bytes_per_pixel;
         }
-        stream.close();
     }
 }
 
@@ -85,70 +199,52 @@ void Image::special_byte(int number, int * byte0, int * byte1, int * byte2, int
 /**
  * \brief Method to save an Image class into .TGA
  *
- * Saves this Image in filename file (.TGA)
+ * Saves this Image in filename file (.TGA), 24 bits.
+ * The file is built in memory, one scanline at a time,
+ * then written at once
  *
  * \param filename : name of the file to save into, with extension
+ * \param compressed : whether to run-length encode the pixels (type 10)
  */
-void Image::save_to_TGA(const std::string& filename) const {
-    std::ofstream stream;
-    stream.open(filename.c_str());
+void Image::save_to_TGA(const std::string& filename, bool compressed) const {
+    std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary);
     if (!stream) {
         std::cout << "Can't write the TGA file " << filename << std::endl;
         return;
     }
-    else {
-        // HEADER
-        stream.put(0);
-        stream.put(0);
-        stream.put(2);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-        stream.put(0);
-
-
-        // resX
-        int byte0, byte1, byte2, byte3;
-
-        special_byte(_res_x, &byte0, &byte1, &byte2, &byte3);
-        stream.put(byte0);
-        stream.put(byte1);
-
-        // resY
-        special_byte(_res_y, &byte0, &byte1, &byte2, &byte3);
-        stream.put(byte0);
-        stream.put(byte1);
-
-        stream.put(24);
-        stream.put(0);
-
-    // Storing DATA // Left to right, up to down
-        for (int j = _res_y-1; j >= 0; j--) {
-            for (int i = 0; i < _res_x;i++) {
-            	Color c = *(_matrix[i][j]) ;
-            	stream.put( (unsigned char)( 255.0*(c.get_b() < 1.0 ? c.get_b() : 1.0) ) );
-                stream.put( (unsigned char)( 255.0*(c.get_g() < 1.0 ? c.get_g() : 1.0) ) );
-                stream.put( (unsigned char)( 255.0*(c.get_r() < 1.0 ? c.get_r() : 1.0) ) );
-            }
+
+    vector<unsigned char> data;
+    data.reserve(18 + 3 * _res_x * _res_y);
+
+    // HEADER
+    int byte0, byte1, byte2, byte3;
+    data.resize(18, 0);
+    data[2] = compressed ? 10 : 2;
+    special_byte(_res_x, &byte0, &byte1, &byte2, &byte3);
+    data[12] = byte0;
+    data[13] = byte1;
+    special_byte(_res_y, &byte0, &byte1, &byte2, &byte3);
+    data[14] = byte0;
+    data[15] = byte1;
+    data[16] = 24;
+
+    // Storing DATA // Left to right, down to up
+    vector<unsigned char> row(3 * _res_x);
+    for (int j = _res_y-1; j >= 0; j--) {
+        const float *src = &_pixels[3 * j * _res_x];
+        for (int k = 0; k < 3 * _res_x; k += 3) {
+            // Blue, green, red, saturated to 1
+            row[k] = (unsigned char)( 255.0*(src[k+2] < 1.0f ? (src[k+2] > 0.0f ? src[k+2] : 0.0f) : 1.0f) );
+            row[k+1] = (unsigned char)( 255.0*(src[k+1] < 1.0f ? (src[k+1] > 0.0f ? src[k+1] : 0.0f) : 1.0f) );
+            row[k+2] = (unsigned char)( 255.0*(src[k] < 1.0f ? (src[k] > 0.0f ? src[k] : 0.0f) : 1.0f) );
         }
-        stream.close();
-        return;
+        if (compressed)
+            rle_encode_row(&row[0], _res_x, data);
+        else
+            data.insert(data.end(), row.begin(), row.end());
     }
-}
 
-/**
- * \brief Adds a color to a given position in the matrix
- *
- * Correponding pixel in the matrix receives the given color
- *
- * \param color : Pointer to the color to save
- * \param x, y : Position in the matrix of the pixel to modify
- */
-void Image::add_color(boost::shared_ptr<Color> color, int x, int y) {
-    _matrix[x][y] = color ;
+    stream.write((const char *)&data[0], data.size());
+    if (!stream)
+        std::cout << "Can't write the TGA file " << filename << std::endl;
 }
@@ -11,7 +11,6 @@
 #include <string>
 #include <iostream>
 #include <vector>
-#include <boost/smart_ptr/shared_ptr.hpp>
 #include "color.hpp"
 
 /**
@@ -22,38 +21,70 @@
  * calculated colors during the rendering phase
  * It possesses methods to save its content into
  * an image formatted file, or to read one
+ *
+ * The pixels are kept in one contiguous buffer of floats,
+ * row after row, each pixel being three interleaved components
+ * (red, green, blue). Writing distinct pixels from several
+ * threads is safe.
  */
 class Image {
     public:
     	/**
-    	 * \brief Constructor
+    	 * \brief Constructor of a black image
     	 * \param x : width resolution
     	 * \param y : height resolution
     	 */
 		Image(int x, int y) :
-			_res_x(x), _res_y(y)
-		{
-			_matrix.resize(x);
-			for (int i = 0; i < x; i++)
-				_matrix.at(i).resize(y);
-		}
+			_res_x(x), _res_y(y), _pixels(3 * x * y, 0.0f) {}
 		Image(std::string);
 
 		int get_res_x() const { return _res_x ; } ///< Returns the width resolution
 		int get_res_y() const { return _res_y ; } ///< Returns the height resolution
 
-        void add_color(boost::shared_ptr< Color >, int, int);	///< Add a new pixel to the matrix
+		/**
+		 * \brief Replaces the color of a pixel
+		 * \param color : the new color
+		 * \param x, y : position of the pixel
+		 */
+		void set_color(const Color& color, int x, int y)
+		{
+			float *pixel = &_pixels[3 * (y * _res_x + x)] ;
+			pixel[0] = (float)color.get_r() ;
+			pixel[1] = (float)color.get_g() ;
+			pixel[2] = (float)color.get_b() ;
+		}
+
+		/**
+		 * \brief Accumulates a color into a pixel
+		 * \param color : the color to add
+		 * \param x, y : position of the pixel
+		 */
+		void add_color(const Color& color, int x, int y)
+		{
+			float *pixel = &_pixels[3 * (y * _res_x + x)] ;
+			pixel[0] += (float)color.get_r() ;
+			pixel[1] += (float)color.get_g() ;
+			pixel[2] += (float)color.get_b() ;
+		}
+
+		/**
+		 * \brief Returns the color of a pixel
+		 * \param x, y : position of the pixel
+		 */
+		Color get_color(int x, int y) const
+		{
+			const float *pixel = &_pixels[3 * (y * _res_x + x)] ;
+			return Color(pixel[0], pixel[1], pixel[2]) ;
+		}
+
+		const float* get_data() const { return &_pixels[0] ; } ///< Returns the pixels, row after row, as interleaved red/green/blue components
 
-        boost::shared_ptr<Color> get_color(int x, int y) const ///< Returns the color corresponding to the given coordinates
-        {
-            return _matrix[x][y];
-        }
         static void special_byte(int, int *, int *, int *, int *);	///< Byte special conversion (used when saving into BMP/TGA)
-        void save_to_TGA(const std::string&) const; ///< Saving in a TGA file
+        void save_to_TGA(const std::string&, bool compressed = false) const; ///< Saving in a TGA file, run-length encoded if compressed
 
     private:
         int _res_x, _res_y;		///< Width and Heigth of image
-        std::vector< std::vector< boost::shared_ptr< Color > > > _matrix;	///< Matrix of pixels (Color)
+        std::vector<float> _pixels;	///< Pixels, row-major, three floats (red, green, blue) each
 };
 
 #endif
@@ -7,6 +7,8 @@
 #include <cmath>
 #include "launchable.hpp"
 
+const double Launchable::SURFACE_EPSILON = 1e-7 ;
+
 /***
  * \param couple : first member is the intersection point,
  * second is the normal at this point
@@ -7,6 +7,7 @@
  * \author T.FEIGLER / B.BORGOBELLO
  */
 
+#include <limits>
 #include "geometry.hpp"
 
 /**
@@ -15,7 +16,9 @@
  *
  * Class Launchable describes the different
  * possible interactions of a Photon or a Ray
- * with things in space
+ * with things in space. Only the intersections
+ * in its interval ]t_min, t_max[ of distances
+ * from its position are kept
  */
 class Launchable
 {
@@ -28,20 +31,29 @@ public:
 	 * \param point : initial position of the launchable
 	 * \param vector : initial direction of the launchable
 	 */
-	Launchable( Point3D point, Vector3D vector) : _end_point(point)
+	Launchable( Point3D point, Vector3D vector) : _end_point(point),
+		_t_min(0.0), _t_max(std::numeric_limits<double>::max())
 		{_direction = (vector.norm() == 0) ? vector: vector.normalized();}
 
 	const Point3D& get_end_point() const { return _end_point ; } ///< Returns the actual position of the launchable
 	const Vector3D& get_direction() const { return _direction ; } ///< Returns the actual direction of the launchable
+	double get_t_min() const { return _t_min ; } ///< Returns the distance up to which the intersections are ignored
+	double get_t_max() const { return _t_max ; } ///< Returns the distance from which the intersections are ignored
 
 	Vector3D get_reflected(const Couple3D &) const ; ///< Returns the reflected direction
 	Vector3D get_refracted(const Couple3D &, double) const ; ///< Returns the refracted direction
 	void set_end_point(Point3D end_point) { _end_point = end_point;} ///< Sets the current position of the launchable
 	void set_direction(Vector3D direction) { _direction = direction;} ///< Sets the current direction of the launchable
+	void set_interval(double t_min, double t_max) { _t_min = t_min; _t_max = t_max;} ///< Sets the interval of distances where the intersections are kept
+	void leave_surface() { set_interval(SURFACE_EPSILON, std::numeric_limits<double>::max());} ///< Ignores the surface the launchable starts from, its position being on it
+
+	static const double SURFACE_EPSILON ; ///< Smallest distance kept from a surface point : nearer, it is this surface met again because of the rounding
 
 private:
 	Point3D _end_point ; ///< Current position of the launchable
 	Vector3D _direction ; ///< Current direction of the launchable
+	double _t_min ; ///< Intersections up to this distance are ignored
+	double _t_max ; ///< Intersections from this distance are ignored
 };
 
 #endif /* LAUNCHABLE_HPP_ */
@@ -0,0 +1,115 @@
+#ifndef RAY_PACKET_HPP_
+#define RAY_PACKET_HPP_
+
+/**
+ * \file ray_packet.hpp
+ * \brief Declaration of struct RayPacket
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include "launchable.hpp"
+#include "simd.hpp"
+
+/**
+ * \struct RayPacket
+ * \brief Up to four launchables traced together, their components laid out for Double4
+ *
+ * Meant for coherent launchables such as the camera rays of neighbouring
+ * pixels, which mostly go through the same BVH nodes and hit the same
+ * shapes. The unused lanes repeat the first launchable and are left
+ * out of the active mask. The packet holds a copy of its launchables,
+ * so it can also be filled from arrays of components.
+ */
+struct RayPacket
+{
+	static const int SIZE = 4 ; ///< Number of lanes
+
+	/**
+	 * \brief Constructor
+	 * \param launchables : the launchables to trace
+	 * \param nb : the number of launchables, 1 to SIZE
+	 */
+	RayPacket(const Launchable* const* launchables, int nb) : active((1 << nb) - 1)
+	{
+		double o[3][SIZE], d[3][SIZE], t0[SIZE], t1[SIZE] ;
+		for (int i = 0; i < SIZE; i++) {
+			const Launchable& l = *launchables[(i < nb) ? i : 0] ;
+			t0[i] = l.get_t_min() ;
+			t1[i] = l.get_t_max() ;
+			for (int a = 0; a < 3; a++) {
+				o[a][i] = l.get_end_point()[a] ;
+				d[a][i] = l.get_direction()[a] ;
+			}
+		}
+		set_lanes(o, d, t0, t1) ;
+	}
+
+	/**
+	 * \brief Constructor from launchables laid out as arrays of components
+	 * \param origin : the components of the origins, lane i reading origin[a][i]
+	 * \param direction : the components of the unit directions
+	 * \param t_min : the distance of each launchable up to which the intersections are ignored
+	 * \param nb : the number of launchables, 1 to SIZE
+	 *
+	 * The launchables have no t_max
+	 */
+	RayPacket(const double* const origin[3], const double* const direction[3], const double* t_min, int nb) :
+		active((1 << nb) - 1)
+	{
+		double o[3][SIZE], d[3][SIZE], t0[SIZE], t1[SIZE] ;
+		for (int i = 0; i < SIZE; i++) {
+			int j = (i < nb) ? i : 0 ;
+			t0[i] = t_min[j] ;
+			t1[i] = std::numeric_limits<double>::max() ;
+			for (int a = 0; a < 3; a++) {
+				o[a][i] = origin[a][j] ;
+				d[a][i] = direction[a][j] ;
+			}
+		}
+		set_lanes(o, d, t0, t1) ;
+	}
+
+	/**
+	 * \brief Returns the launchable of a lane, with its interval
+	 */
+	Launchable get_launchable(int lane) const
+	{
+		double o[3][SIZE], d[3][SIZE], t0[SIZE], t1[SIZE] ;
+		for (int a = 0; a < 3; a++) {
+			origin[a].store(o[a]) ;
+			direction[a].store(d[a]) ;
+		}
+		t_min.store(t0) ;
+		t_max.store(t1) ;
+
+		Vector3D dir(d[0][lane], d[1][lane], d[2][lane]) ;
+		Launchable l(Point3D(o[0][lane], o[1][lane], o[2][lane]), dir) ;
+		l.set_direction(dir) ; // as it is, the constructor normalizes it once more
+		l.set_interval(t0[lane], t1[lane]) ;
+		return l ;
+	}
+
+	Double4 origin[3] ; ///< Components of the origins
+	Double4 direction[3] ; ///< Components of the directions
+	Double4 inv_direction[3] ; ///< Componentwise inverses of the directions, for the slab tests
+	Double4 t_min ; ///< Distance of each lane up to which the intersections are ignored
+	Double4 t_max ; ///< Distance of each lane from which the intersections are ignored
+	int active ; ///< Lanes holding a launchable to trace, lane i as bit i
+
+private:
+	/**
+	 * \brief Fills the lanes from their components
+	 */
+	void set_lanes(const double o[3][SIZE], const double d[3][SIZE], const double t0[SIZE], const double t1[SIZE])
+	{
+		for (int a = 0; a < 3; a++) {
+			origin[a] = Double4(o[a][0], o[a][1], o[a][2], o[a][3]) ;
+			direction[a] = Double4(d[a][0], d[a][1], d[a][2], d[a][3]) ;
+			inv_direction[a] = Double4(1.0 / d[a][0], 1.0 / d[a][1], 1.0 / d[a][2], 1.0 / d[a][3]) ;
+		}
+		t_min = Double4(t0[0], t0[1], t0[2], t0[3]) ;
+		t_max = Double4(t1[0], t1[1], t1[2], t1[3]) ;
+	}
+};
+
+#endif /* RAY_PACKET_HPP_ */
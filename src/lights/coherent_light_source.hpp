@@ -36,8 +36,8 @@ public :
 
     const Point3D& get_location() const { return _location ; } ///< Returns the position of the source
 
-    virtual bool is_viewable_from(const Point3D, const std::vector< boost::shared_ptr<Shape> >&) const = 0; ///< Whether a source is visible from a point of space
-    virtual boost::shared_ptr<Photon> random_photon() = 0; ///< Randomly generates a Photon
+    virtual bool is_viewable_from(const Point3D, const Scene&) const = 0; ///< Whether a source is visible from a point of space
+    virtual Photon emit_photon(Sampler&) const = 0; ///< Randomly generates a Photon, drawing from its own sampler
 
 protected :
     Point3D _location; ///< Position of the source in space
@@ -33,8 +33,10 @@ public :
         CoherentLightSource(color, power, location), _direction(direction.normalized()) {}
     ~HemisphericalSource() {}
 
-    virtual bool is_viewable_from(Point3D, const std::vector< boost::shared_ptr<Shape> >&) const ; ///< Whether the center is visible from a point of space
-    virtual boost::shared_ptr<Photon> random_photon(); ///< Randomly generates a Photon
+    virtual bool is_viewable_from(Point3D, const Scene&) const ; ///< Whether the center is visible from a point of space
+    virtual Photon emit_photon(Sampler&) const ; ///< Randomly generates a Photon
+    virtual Color get_direct_illumination(const Point3D&, const Vector3D&,
+        const Scene&, Sampler&, unsigned int) const ; ///< Light received from the center with one shadow ray
 private :
     Vector3D _direction;
 };
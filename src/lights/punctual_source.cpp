@@ -4,6 +4,7 @@
  * \author B.BORGOBELLO / T.FEIGLER
  */
 
+#include <cmath>
 #include <iostream>
 #include "punctual_source.hpp"
 #include <Eigen/Array>
@@ -12,48 +13,41 @@
  * Returns whether this source is visible from a point
  * in space
  * \param point : point in space
- * \param shapes : list of all the shapes of the scene
- * which may eclipse the source
+ * \param scene : the scene whose shapes
+ * may eclipse the source
  */
-bool PunctualSource::is_viewable_from(Point3D point, const std::vector< boost::shared_ptr<Shape> >& shapes) const
+bool PunctualSource::is_viewable_from(Point3D point, const Scene& scene) const
 {
-	using namespace std ;
-
-    Vector3D direction = (point - _location).normalized() ;
-    Launchable launch_test(_location, direction) ;
-
-    double nearest_distance_2 = -1.0 ;
-
-    for (unsigned int i = 0; i < shapes.size(); i++) {
-        if (shapes[i]->is_intersected_by(launch_test))
-        {
-        	Point3D intersection =
-        			shapes[i]->get_nearest_intersection_with_normal(launch_test).first ;
-        	double this_distance_2 = ( intersection - _location ).squaredNorm() ;
-
-        	if(nearest_distance_2 < 0.0 || this_distance_2 < nearest_distance_2)
-        		nearest_distance_2 = this_distance_2 ;
-        }
-    }
-
-    double result = nearest_distance_2 - (point - _location).squaredNorm() ;
-    const double epsilon = 1.0e-12 ;
-
-    return (result < epsilon) && (result > -epsilon) ;
+    return !scene.occluded(point, _location) ;
 }
 
 /**
- * \brief Generates a photon with a random direction
- * starting from this source's center
+ * \param point : the lit point of a surface
+ * \param normal : the normal at this point, on the side of the viewer
+ * \param scene : the scene whose shapes may eclipse the source
+ *
+ * The photons leave the center over 4 pi steradians : the density
+ * they would give at the point is power * cos / (4 * distance^2)
  */
-boost::shared_ptr<Photon> PunctualSource::random_photon() {
-    using namespace std;
-    boost::shared_ptr<Photon> photon;
+Color PunctualSource::get_direct_illumination(const Point3D& point, const Vector3D& normal,
+    const Scene& scene, Sampler&, unsigned int) const
+{
+    Vector3D to_source = _location - point ;
+    double distance_2 = to_source.squaredNorm() ;
+    double cos_theta = normal.dot(to_source) / sqrt(distance_2) ;
 
-    Vector3D vector = Vector3d::Random();
-    vector.normalize();
+    if (cos_theta <= 0 || !is_viewable_from(point, scene))
+        return Color(0.0, 0.0, 0.0) ;
 
-    photon = boost::shared_ptr<Photon>(new Photon(_location, vector, _color));
+    double coef = _power * cos_theta / (4.0 * distance_2) ;
+    return Color(coef * _color.get_r(), coef * _color.get_g(), coef * _color.get_b()) ;
+}
 
-    return photon;
+/**
+ * \brief Generates a photon with a direction uniformly distributed
+ * over the sphere, starting from this source's center
+ * \param sampler : the random generator of the photon
+ */
+Photon PunctualSource::emit_photon(Sampler& sampler) const {
+    return Photon(_location, sampler.next_unit_vector(), _color);
 }
@@ -9,7 +9,9 @@
 
 #include "light.hpp"
 #include "../launchables/photon.hpp"
-#include <boost/smart_ptr/shared_ptr.hpp>
+#include "../sampler.hpp"
+
+class Scene;
 
 /**
  * \class RadiantObject
@@ -29,7 +31,22 @@ public :
      */
     RadiantObject(Color color, float power) : Light(color, power) {}
 
-    virtual boost::shared_ptr<Photon> random_photon() = 0; ///< Randomly generates a Photon
+    virtual Photon emit_photon(Sampler&) const = 0; ///< Randomly generates a Photon, drawing from its own sampler, returned by value for the photon wavefronts
+
+    /**
+     * \brief Light received directly from this source, traced with shadow rays
+     * \param point : the lit point of a surface
+     * \param normal : the normal at this point, on the side of the viewer
+     * \param scene : the scene whose shapes may eclipse the source
+     * \param sampler : the random generator of the current pixel
+     * \param nb_samples : the number of shadow rays for sources which are not punctual
+     *
+     * Returned in the unit of the photon density estimate (power over squared
+     * distance) : it equals what the photons landing directly from this
+     * source would give, without their noise.
+     */
+    virtual Color get_direct_illumination(const Point3D& point, const Vector3D& normal,
+        const Scene& scene, Sampler& sampler, unsigned int nb_samples) const = 0;
 };
 
 #endif
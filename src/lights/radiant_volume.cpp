@@ -4,22 +4,54 @@
  * \author B.BORGOBELLO / T.FEIGLER
  */
 
+#include <cmath>
 #include <iostream>
 #include "radiant_volume.hpp"
 #include <Eigen/Array>
 
+/**
+ * \param point : the lit point of a surface
+ * \param normal : the normal at this point, on the side of the viewer
+ * \param scene : the scene whose shapes may eclipse the source
+ * \param sampler : the random generator of the current pixel
+ * \param nb_samples : the number of shadow rays
+ *
+ * The points of the surface are drawn as the emission points of the
+ * photons, which then leave uniformly over the outward hemisphere :
+ * each visible sample adds power * cos / (2 * distance^2), whatever
+ * the angle under which it sees the point.
+ */
+Color RadiantVolume::get_direct_illumination(const Point3D& point, const Vector3D& normal,
+    const Scene& scene, Sampler& sampler, unsigned int nb_samples) const
+{
+    double sum = 0.0;
+
+    for (unsigned int i = 0; i < nb_samples; i++) {
+        Couple3D surface = _volume.get_random_surface_point(sampler);
+        Vector3D to_source = surface.first - point;
+        double distance_2 = to_source.squaredNorm();
+        double cos_theta = normal.dot(to_source) / sqrt(distance_2);
+
+        if (cos_theta <= 0 || surface.second.dot(to_source) >= 0) continue;
+        if (scene.occluded(point, surface.first)) continue;
+
+        sum += cos_theta / distance_2;
+    }
+    if (nb_samples == 0) return Color(0.0, 0.0, 0.0);
+
+    double coef = _power * sum / (2.0 * nb_samples);
+    return Color(coef * _color.get_r(), coef * _color.get_g(), coef * _color.get_b());
+}
+
 /**
  * \brief Generates a photon with a random direction
  * from a random point of the volume
+ * \param sampler : the random generator of the photon
  */
-boost::shared_ptr<Photon> RadiantVolume::random_photon() {
-    using namespace std;
-    boost::shared_ptr<Photon> photon;
-    static double epsilon = 1e-6;
-
-    Couple3D couple = _volume.get_random_point_and_normal();
-    photon = boost::shared_ptr<Photon>(new Photon(couple.first, couple.second, _color));
-    photon->set_end_point(photon->get_end_point() + photon->get_direction()*epsilon);
+Photon RadiantVolume::emit_photon(Sampler& sampler) const {
+    Couple3D couple = _volume.get_random_point_and_normal(sampler);
+    Photon photon(couple.first, couple.second, _color);
+    photon.leave_surface();
 
     return photon;
 }
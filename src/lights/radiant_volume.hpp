@@ -20,7 +20,7 @@
  *
  * Radiant volumes represents the potential
  * volumes emitting Photons for the photon-mapping
- * (can not direct illuminate)
+ * (their direct illumination is sampled on their surface)
  * Derived from RadiantObject class
  */
 
@@ -37,7 +37,9 @@ public :
         RadiantObject(color, power), _volume(volume) {}
 
     const Volume& get_volume() const { return _volume ; } ///< Returns the volume used
-    boost::shared_ptr<Photon> random_photon(); ///< Randomly generates a Photon
+    Photon emit_photon(Sampler&) const ; ///< Randomly generates a Photon
+    Color get_direct_illumination(const Point3D&, const Vector3D&,
+        const Scene&, Sampler&, unsigned int) const ; ///< Light received from the surface of the volume, averaged over random shadow rays
 
 protected :
     Volume& _volume; ///< Volume emitting light
@@ -24,12 +24,17 @@ int main(int argc, char ** argv)
     srand(time(0));
 
     string in_filename = "none", out_image_name = "result.tga", out_photonmap_image_name, temp_string;
+    string load_photonmap_name, save_photonmap_name;
     bool display = false;
     bool photon_map = false;
+    bool compressed = false;
 
     for (int i = 1 ; i < argc; i++) {
         temp_string = argv[i];
-        if (temp_string.find("-t") != -1) {
+        // Options taking a file name first, the name could contain "-t"
+        if (temp_string.find("--save-photonmap=") == 0) save_photonmap_name = temp_string.substr(17);
+        else if (temp_string.find("--load-photonmap=") == 0) load_photonmap_name = temp_string.substr(17);
+        else if (temp_string.find("-t") != -1) {
             out_image_name = "result_image.tga";
             out_photonmap_image_name = "result_pm.tga";
             photon_map = true;
@@ -40,6 +45,7 @@ int main(int argc, char ** argv)
             photon_map = true;
         }
         else if (temp_string.find("--display") != -1) display = true;
+        else if (temp_string.find("--rle") != string::npos) compressed = true;
 
         if (temp_string[0] != '-') in_filename = temp_string;
     }
@@ -48,7 +54,10 @@ int main(int argc, char ** argv)
         cout << "Usage :" << endl;
         cout << "--out=FILENAME : File for output image" << endl;
         cout << "--photonmap=FILENAME : File for output photon map image" << endl;
-        cout << "--display : Display the image immediately after the computation has ended" << endl << endl;
+        cout << "--save-photonmap=FILENAME : File where the photon map is saved for later runs" << endl;
+        cout << "--load-photonmap=FILENAME : Photon map saved by a previous run, rebuilt if the scene or the photon parameters changed" << endl;
+        cout << "--display : Display the image immediately after the computation has ended" << endl;
+        cout << "--rle : Run-length encode the TGA files written" << endl << endl;
         cout << "-t : Basic testing params -> generates image and photonmap inside result_image and result_pm" << endl << endl;
         cout << "first paramless argument : Input YAML file" << endl << endl;
 
@@ -76,20 +85,20 @@ int main(int argc, char ** argv)
     cout << "Building scene\n" ;
     renderer.build_scene() ;
     cout << "Building photon tree...\n\n" ;
-    renderer.build_photon_tree() ;
+    renderer.build_photon_tree(load_photonmap_name, save_photonmap_name) ;
     cout << "Raytracing...\n\n" ;
 
     if (photon_map) {
         renderer.raytrace(true) ;
         cout << "Saving file " + out_photonmap_image_name + "...\n\n" ;
-        renderer.save_to(out_photonmap_image_name) ;
+        renderer.save_to(out_photonmap_image_name, compressed) ;
         temp_string = "display " + out_photonmap_image_name + " &" ;
         if (display) system(temp_string.c_str()) ;
     }
 
     renderer.raytrace(false) ;
     cout << "Saving ...\n\n" ;
-    renderer.save_to(out_image_name) ;
+    renderer.save_to(out_image_name, compressed) ;
     temp_string = "display " + out_image_name + " &";
     if (display) system(temp_string.c_str()) ;
 
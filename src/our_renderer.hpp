@@ -22,9 +22,9 @@ public:
 
     void parse_file(std::string filename) ; ///< Parses the given file
     void build_scene()  ;                   ///< Builds the scene of the given file
-    void build_photon_tree() ;              ///< Launches the photon-mapping phase
+    void build_photon_tree(std::string load_filename = "", std::string save_filename = "") ; ///< Launches the photon-mapping phase, or reads its result from a file
     void raytrace(bool) ;                   ///< Creates an Image corresponding to the created scene (photon-map or normal raytracing)
-    void save_to(std::string) ;             ///< Saves the previously created Image into .TGA
+    void save_to(std::string, bool compressed = false) ; ///< Saves the previously created Image into .TGA (run-length encoded if compressed)
 
 private:
     ParserYAML * _parser;                   ///< Contains the ROOT ParserYAML, with the scene
@@ -53,12 +53,18 @@ void OurRenderer::build_scene() {
 }
 
 /**
+ * \param load_filename : photon map file saved by a previous run, empty for none
+ * \param save_filename : file where the photon map is saved, empty for none
+ *
  * Creates the photon map, by launching photons from all the light
- * sources (but GlobalLighting)
+ * sources (but GlobalLighting). The map is read from load_filename
+ * instead if it was saved for the same scene and photon parameters
  */
-void OurRenderer::build_photon_tree()
+void OurRenderer::build_photon_tree(std::string load_filename, std::string save_filename)
 {
-    _raytracer = new PhotonMappingBased(_scene) ;
+    _raytracer = new PhotonMappingBased(_scene, load_filename) ;
+    if (!save_filename.empty() && _raytracer->save_photon_map(save_filename))
+        std::cout << "Photon map saved into " << save_filename << std::endl << std::endl ;
 }
 
 /**
@@ -88,11 +94,13 @@ void OurRenderer::raytrace(bool the_photon_map = false)
  * \param str : absolute or relative path
  * in which we want to save in the Image (with extension TGA)
  *
+ * \param compressed : whether the TGA is run-length encoded
+ *
  * Saves the previously created Image in a file on the hardrive
  */
-void OurRenderer::save_to(std::string str)
+void OurRenderer::save_to(std::string str, bool compressed)
 {
-    _image->save_to_TGA(str.c_str()) ;
+    _image->save_to_TGA(str.c_str(), compressed) ;
 }
 
 #endif
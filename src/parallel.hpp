@@ -0,0 +1,62 @@
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+/**
+ * \file parallel.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of the parallel task loop
+ */
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/**
+ * \brief Returns the number of threads to use
+ * \param wanted : the number of threads asked for, 0 for one per hardware thread
+ */
+inline unsigned int get_nb_threads(int wanted)
+{
+	if (wanted > 0) return wanted ;
+
+	unsigned int hardware = std::thread::hardware_concurrency() ;
+	return (hardware > 0) ? hardware : 1 ;
+}
+
+/**
+ * \brief Runs nb_tasks independent tasks over a pool of threads
+ * \param nb_tasks : number of tasks, numbered from 0
+ * \param nb_threads : number of threads of the pool
+ * \param task : functor called as task(task_index, thread_index)
+ *
+ * Each thread takes the next task not started yet, so a thread
+ * done with cheap tasks keeps on helping with the expensive ones.
+ * The thread_index (in [0, nb_threads)) lets the task use scratch
+ * storage of its own. Returns when all the tasks are done.
+ */
+template <class Task>
+void parallel_for(unsigned int nb_tasks, unsigned int nb_threads, Task& task)
+{
+	if (nb_threads > nb_tasks) nb_threads = nb_tasks ;
+	if (nb_threads <= 1) {
+		for (unsigned int i = 0; i < nb_tasks; i++)
+			task(i, 0) ;
+		return ;
+	}
+
+	std::atomic<unsigned int> next_task(0) ;
+	std::vector<std::thread> pool ;
+	pool.reserve(nb_threads) ;
+
+	for (unsigned int t = 0; t < nb_threads; t++) {
+		pool.push_back(std::thread([&task, &next_task, nb_tasks, t]() {
+			for (unsigned int i = next_task++; i < nb_tasks; i = next_task++)
+				task(i, t) ;
+		})) ;
+	}
+
+	for (unsigned int t = 0; t < nb_threads; t++)
+		pool[t].join() ;
+}
+
+#endif /* PARALLEL_HPP_ */
@@ -0,0 +1,391 @@
+/**
+ * \file mesh_loader.cpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Implementation of the readers of mesh files
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+#include "mesh_loader.hpp"
+
+/**
+ * \brief Exits after telling why a mesh file can not be used
+ */
+static void mesh_failure(const std::string& filename, const std::string& reason)
+{
+	std::cout << std::endl << "CRITICAL FAILURE : The mesh file " << filename << " " << reason << std::endl;
+	exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief Returns whether the triangle of the given corners has an area
+ */
+static bool has_area(const std::vector<Point3D>& positions, unsigned int a, unsigned int b, unsigned int c)
+{
+	return (positions[b] - positions[a]).cross(positions[c] - positions[a]).squaredNorm() > 0;
+}
+
+/**
+ * \brief Returns the given normal with a unit length, or unchanged if it is null
+ */
+static Vector3D get_unit_normal(const Vector3D& normal)
+{
+	return (normal.squaredNorm() > 0) ? Vector3D(normal.normalized()) : normal;
+}
+
+/**
+ * \brief Reads three numbers separated by spaces
+ * \param p : where the numbers start
+ * \param v : filled with the numbers
+ *
+ * Returns whether the three numbers were found
+ */
+static bool read_doubles(const char* p, double v[3])
+{
+	for (int i = 0; i < 3; i++) {
+		char* end;
+		v[i] = strtod(p, &end);
+		if (end == p) return false;
+		p = end;
+	}
+	return true;
+}
+
+/**
+ * \param filename : the OBJ file
+ * \param data : filled with the mesh
+ *
+ * Only the vertices (v), their normals (vn) and the faces (f) are read.
+ * Since OBJ indexes the positions and the normals separately, each pair
+ * (position, normal) used by a corner becomes a vertex of the mesh. The
+ * normals are dropped unless every corner has one
+ */
+static void load_obj(const std::string& filename, MeshData& data)
+{
+	std::ifstream stream(filename.c_str());
+	if (!stream) mesh_failure(filename, "can't be read or doesn't exist");
+
+	std::vector<Point3D> positions;
+	std::vector<Vector3D> normals;
+	std::vector< std::pair<long, long> > corners; // position and normal (-1 if none) of each corner, three per triangle
+	std::vector< std::pair<long, long> > face;
+	bool all_normals = true;
+
+	std::string line;
+	while (std::getline(stream, line)) {
+		const char* p = line.c_str();
+		while (*p == ' ' || *p == '\t') p++;
+		double v[3];
+
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			if (!read_doubles(p + 1, v)) mesh_failure(filename, "has a vertex without three coordinates");
+			positions.push_back(Point3D(v[0], v[1], v[2]));
+		}
+		else if (p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+			if (!read_doubles(p + 2, v)) mesh_failure(filename, "has a normal without three coordinates");
+			normals.push_back(Vector3D(v[0], v[1], v[2]));
+		}
+		else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			face.clear();
+			p++;
+			while (true) {
+				char* end;
+				long position = strtol(p, &end, 10);
+				if (end == p) break;
+				p = end;
+
+				bool has_normal = false;
+				long normal = 0;
+				if (*p == '/') {
+					strtol(++p, &end, 10); // texture coordinates, unused
+					p = end;
+					if (*p == '/') {
+						normal = strtol(++p, &end, 10);
+						has_normal = (end != p);
+						p = end;
+					}
+				}
+
+				// Indices start at 1, negative ones count back from the last element read
+				position = (position < 0) ? (long)positions.size() + position : position - 1;
+				if (position < 0 || position >= (long)positions.size())
+					mesh_failure(filename, "has a face referring to a missing vertex");
+				if (has_normal) {
+					normal = (normal < 0) ? (long)normals.size() + normal : normal - 1;
+					if (normal < 0 || normal >= (long)normals.size())
+						mesh_failure(filename, "has a face referring to a missing normal");
+				}
+				else {
+					normal = -1;
+					all_normals = false;
+				}
+				face.push_back(std::make_pair(position, normal));
+			}
+			if (face.size() < 3) mesh_failure(filename, "has a face with less than three corners");
+
+			for (unsigned int k = 1; k + 1 < face.size(); k++)
+				if (has_area(positions, face[0].first, face[k].first, face[k+1].first)) {
+					corners.push_back(face[0]);
+					corners.push_back(face[k]);
+					corners.push_back(face[k+1]);
+				}
+		}
+	}
+
+	data.indices.reserve(corners.size());
+	if (all_normals && !normals.empty()) {
+		std::unordered_map<uint64_t, unsigned int> vertex_of_pair;
+		for (unsigned int i = 0; i < corners.size(); i++) {
+			uint64_t key = ((uint64_t)corners[i].first << 32) | (uint64_t)corners[i].second;
+			std::pair<std::unordered_map<uint64_t, unsigned int>::iterator, bool> inserted =
+				vertex_of_pair.insert(std::make_pair(key, (unsigned int)data.vertices.size()));
+			if (inserted.second) {
+				data.vertices.push_back(positions[corners[i].first]);
+				data.normals.push_back(get_unit_normal(normals[corners[i].second]));
+			}
+			data.indices.push_back(inserted.first->second);
+		}
+	}
+	else {
+		data.vertices.swap(positions);
+		for (unsigned int i = 0; i < corners.size(); i++)
+			data.indices.push_back(corners[i].first);
+	}
+}
+
+/**
+ * \brief Types of the properties of a PLY file
+ */
+enum PlyType { PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_UNKNOWN };
+
+/**
+ * \brief Encodings of the data of a PLY file
+ */
+enum PlyFormat { PLY_ASCII, PLY_LITTLE_ENDIAN, PLY_BIG_ENDIAN };
+
+/**
+ * \brief Property of the elements of a PLY file, a single value or a list of values
+ */
+struct PlyProperty
+{
+	std::string name ; ///< Name of the property
+	PlyType type ; ///< Type of the value, or of each value of the list
+	PlyType count_type ; ///< Type of the size of the list
+	bool is_list ; ///< Whether the property is a list
+};
+
+/**
+ * \brief Element declared in the header of a PLY file (vertex, face...)
+ */
+struct PlyElement
+{
+	std::string name ; ///< Name of the element
+	unsigned long count ; ///< Number of elements in the file
+	std::vector<PlyProperty> properties ; ///< Properties of each element, in the order of the file
+};
+
+/**
+ * \brief Returns the type matching a PLY type name, both the old and the sized names
+ */
+static PlyType get_ply_type(const std::string& name)
+{
+	if (name == "char" || name == "int8") return PLY_INT8;
+	if (name == "uchar" || name == "uint8") return PLY_UINT8;
+	if (name == "short" || name == "int16") return PLY_INT16;
+	if (name == "ushort" || name == "uint16") return PLY_UINT16;
+	if (name == "int" || name == "int32") return PLY_INT32;
+	if (name == "uint" || name == "uint32") return PLY_UINT32;
+	if (name == "float" || name == "float32") return PLY_FLOAT32;
+	if (name == "double" || name == "float64") return PLY_FLOAT64;
+	return PLY_UNKNOWN;
+}
+
+/**
+ * \brief Reads one value of a PLY file
+ * \param stream : the file, after its header
+ * \param type : the type of the value
+ * \param format : the encoding of the file
+ * \param swap : whether the bytes of binary values are in the other order than in memory
+ */
+static double read_ply_value(std::istream& stream, PlyType type, PlyFormat format, bool swap)
+{
+	if (format == PLY_ASCII) {
+		double value = 0;
+		stream >> value;
+		return value;
+	}
+
+	static const int sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+	unsigned char bytes[8];
+	stream.read((char *)bytes, sizes[type]);
+	if (swap) std::reverse(bytes, bytes + sizes[type]);
+
+	switch (type) {
+	case PLY_INT8: { int8_t value; memcpy(&value, bytes, sizeof(value)); return value; }
+	case PLY_UINT8: { uint8_t value; memcpy(&value, bytes, sizeof(value)); return value; }
+	case PLY_INT16: { int16_t value; memcpy(&value, bytes, sizeof(value)); return value; }
+	case PLY_UINT16: { uint16_t value; memcpy(&value, bytes, sizeof(value)); return value; }
+	case PLY_INT32: { int32_t value; memcpy(&value, bytes, sizeof(value)); return value; }
+	case PLY_UINT32: { uint32_t value; memcpy(&value, bytes, sizeof(value)); return value; }
+	case PLY_FLOAT32: { float value; memcpy(&value, bytes, sizeof(value)); return value; }
+	default: { double value; memcpy(&value, bytes, sizeof(value)); return value; }
+	}
+}
+
+/**
+ * \param filename : the PLY file
+ * \param data : filled with the mesh
+ *
+ * The vertices are read from the properties x, y, z (and nx, ny, nz
+ * if they are all present) of the element vertex, the faces from
+ * the list vertex_indices (or vertex_index) of the element face.
+ * The other elements and properties are skipped
+ */
+static void load_ply(const std::string& filename, MeshData& data)
+{
+	std::ifstream stream(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!stream) mesh_failure(filename, "can't be read or doesn't exist");
+
+	// Header
+	std::string line, word;
+	std::getline(stream, line);
+	if (line.compare(0, 3, "ply") != 0) mesh_failure(filename, "is not a PLY file");
+
+	PlyFormat format = PLY_ASCII;
+	std::vector<PlyElement> elements;
+	bool header_ended = false;
+	while (!header_ended && std::getline(stream, line)) {
+		std::istringstream words(line);
+		words >> word;
+		if (word == "format") {
+			words >> word;
+			if (word == "ascii") format = PLY_ASCII;
+			else if (word == "binary_little_endian") format = PLY_LITTLE_ENDIAN;
+			else if (word == "binary_big_endian") format = PLY_BIG_ENDIAN;
+			else mesh_failure(filename, "has an unknown format " + word);
+		}
+		else if (word == "element") {
+			PlyElement element;
+			words >> element.name >> element.count;
+			elements.push_back(element);
+		}
+		else if (word == "property") {
+			if (elements.empty()) mesh_failure(filename, "has a property outside of any element");
+			PlyProperty property;
+			std::string type_name, count_type_name;
+			words >> type_name;
+			property.is_list = (type_name == "list");
+			if (property.is_list) words >> count_type_name >> type_name;
+			words >> property.name;
+			property.type = get_ply_type(type_name);
+			property.count_type = property.is_list ? get_ply_type(count_type_name) : PLY_UINT8;
+			if (property.type == PLY_UNKNOWN || property.count_type == PLY_UNKNOWN)
+				mesh_failure(filename, "has a property of unknown type");
+			elements.back().properties.push_back(property);
+		}
+		else if (word == "end_header")
+			header_ended = true;
+	}
+	if (!header_ended) mesh_failure(filename, "has no end_header");
+
+	uint16_t one = 1;
+	unsigned char first_byte;
+	memcpy(&first_byte, &one, 1);
+	bool swap = (format == (first_byte == 1 ? PLY_BIG_ENDIAN : PLY_LITTLE_ENDIAN));
+
+	// Data
+	std::vector<unsigned int> triangles; // three corners per triangle, before checking them
+	std::vector<double> values;
+	std::vector<unsigned int> face;
+	for (unsigned int e = 0; e < elements.size(); e++) {
+		const PlyElement& element = elements[e];
+		bool is_vertex = (element.name == "vertex");
+		bool is_face = (element.name == "face");
+
+		int coordinates[6] = { -1, -1, -1, -1, -1, -1 }; // properties of x, y, z, nx, ny, nz
+		static const char* coordinate_names[6] = { "x", "y", "z", "nx", "ny", "nz" };
+		int indices_property = -1;
+		for (unsigned int p = 0; p < element.properties.size(); p++) {
+			const PlyProperty& property = element.properties[p];
+			for (int c = 0; c < 6; c++)
+				if (!property.is_list && property.name == coordinate_names[c]) coordinates[c] = p;
+			if (property.is_list && (property.name == "vertex_indices" || property.name == "vertex_index"))
+				indices_property = p;
+		}
+		if (is_vertex && (coordinates[0] < 0 || coordinates[1] < 0 || coordinates[2] < 0))
+			mesh_failure(filename, "has vertices without x, y and z");
+		bool has_normals = is_vertex && coordinates[3] >= 0 && coordinates[4] >= 0 && coordinates[5] >= 0;
+		if (is_vertex) {
+			data.vertices.reserve(element.count);
+			if (has_normals) data.normals.reserve(element.count);
+		}
+
+		values.resize(element.properties.size());
+		for (unsigned long i = 0; i < element.count; i++) {
+			for (unsigned int p = 0; p < element.properties.size(); p++) {
+				const PlyProperty& property = element.properties[p];
+				if (!property.is_list) {
+					values[p] = read_ply_value(stream, property.type, format, swap);
+					continue;
+				}
+				unsigned int size = read_ply_value(stream, property.count_type, format, swap);
+				if ((int)p == indices_property && is_face) face.clear();
+				for (unsigned int k = 0; k < size; k++) {
+					double value = read_ply_value(stream, property.type, format, swap);
+					if ((int)p == indices_property && is_face) face.push_back((value < 0) ? 0xFFFFFFFFu : (unsigned int)value);
+				}
+			}
+			if (!stream) mesh_failure(filename, "is truncated");
+
+			if (is_vertex) {
+				data.vertices.push_back(Point3D(values[coordinates[0]], values[coordinates[1]], values[coordinates[2]]));
+				if (has_normals)
+					data.normals.push_back(get_unit_normal(Vector3D(values[coordinates[3]], values[coordinates[4]], values[coordinates[5]])));
+			}
+			else if (is_face && indices_property >= 0) {
+				if (face.size() < 3) mesh_failure(filename, "has a face with less than three corners");
+				for (unsigned int k = 1; k + 1 < face.size(); k++) {
+					triangles.push_back(face[0]);
+					triangles.push_back(face[k]);
+					triangles.push_back(face[k+1]);
+				}
+			}
+		}
+	}
+
+	data.indices.reserve(triangles.size());
+	for (unsigned int i = 0; i < triangles.size(); i += 3) {
+		if (triangles[i] >= data.vertices.size() || triangles[i+1] >= data.vertices.size() || triangles[i+2] >= data.vertices.size())
+			mesh_failure(filename, "has a face referring to a missing vertex");
+		if (has_area(data.vertices, triangles[i], triangles[i+1], triangles[i+2]))
+			data.indices.insert(data.indices.end(), &triangles[i], &triangles[i] + 3);
+	}
+}
+
+/**
+ * \param filename : an OBJ (.obj) or PLY (.ply, ASCII or binary) file
+ * \param data : filled with the mesh
+ *
+ * The format is given by the extension of the file, whatever its case
+ */
+void load_mesh(const std::string& filename, MeshData& data)
+{
+	std::string extension;
+	std::string::size_type dot = filename.rfind('.');
+	if (dot != std::string::npos) extension = filename.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+	if (extension == "obj") load_obj(filename, data);
+	else if (extension == "ply") load_ply(filename, data);
+	else mesh_failure(filename, "is neither an OBJ nor a PLY file");
+
+	if (data.get_nb_triangles() == 0) mesh_failure(filename, "has no triangle");
+}
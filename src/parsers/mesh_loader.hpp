@@ -0,0 +1,24 @@
+#ifndef MESH_LOADER_HPP_
+#define MESH_LOADER_HPP_
+
+/**
+ * \file mesh_loader.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of the readers of mesh files
+ */
+
+#include <string>
+#include "shapes/triangle_mesh.hpp"
+
+/**
+ * \brief Reads the triangles of a mesh file, exits if it can not be used
+ * \param filename : an OBJ (.obj) or PLY (.ply, ASCII or binary) file
+ * \param data : filled with the vertices, their normals if the file
+ * gives one for each of them, and the triangles
+ *
+ * The polygons are cut into triangles around their first corner,
+ * the triangles without area are left out
+ */
+void load_mesh(const std::string& filename, MeshData& data) ;
+
+#endif /* MESH_LOADER_HPP_ */
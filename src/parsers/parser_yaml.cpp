@@ -20,6 +20,8 @@
 #include <shapes/parallelepiped.hpp>
 #include <shapes/plane.hpp>
 #include <shapes/triangle.hpp>
+#include <shapes/triangle_mesh.hpp>
+#include "mesh_loader.hpp"
 
 #include <lights/punctual_source.hpp>
 #include <lights/hemispherical_source.hpp>
@@ -27,6 +29,7 @@
 #include <lights/radiant_volume.hpp>
 
 #include "global_parameters.hpp"
+#include "hash.hpp"
 
 /**
  * \brief Dynamic allocation of static members of the ParserYAML class
@@ -105,6 +108,16 @@ void ParserYAML::param_init() {
     current_map["Triangle"] = current_vector;
     current_vector.clear();
 
+// mesh
+    current_vector.push_back(pair<string, string>("texture", "string"));
+    current_vector.push_back(pair<string, string>("absorb", "double"));
+    current_vector.push_back(pair<string, string>("reflect", "double"));
+    current_vector.push_back(pair<string, string>("transparency", "double"));
+    current_vector.push_back(pair<string, string>("file", "string"));
+
+    current_map["Mesh"] = current_vector;
+    current_vector.clear();
+
 // reset
     _matrix_param["OBJECTS"] = current_map;
     current_map.clear();
@@ -618,6 +631,177 @@ bool ParserYAML::check_scene()
         cout << "OK" << endl;
     }
 
+    // max_search_radius
+    cout << "max_search_radius" << "\t";
+    if (!subsection.FindValue("max_search_radius")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        double temp;
+        subsection["max_search_radius"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative max_search_radius");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // nb_caustic_photon_MAX
+    cout << "nb_caustic_photon_MAX" << "\t";
+    if (!subsection.FindValue("nb_caustic_photon_MAX")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["nb_caustic_photon_MAX"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative nb_caustic_photon_MAX");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // nb_caustic_photon_to_find
+    cout << "nb_caustic_photon_to_find" << "\t";
+    if (!subsection.FindValue("nb_caustic_photon_to_find")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["nb_caustic_photon_to_find"] >> temp;
+        if (temp <= 0) {
+            _errors.push_back("Error (" + _filename + ") : nb_caustic_photon_to_find must be positive");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // direct_lighting
+    cout << "direct_lighting" << "\t";
+    if (!subsection.FindValue("direct_lighting")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        bool temp;
+        subsection["direct_lighting"] >> temp;
+        cout << "OK" << endl;
+    }
+
+    // shadow_rays
+    cout << "shadow_rays" << "\t";
+    if (!subsection.FindValue("shadow_rays")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["shadow_rays"] >> temp;
+        if (temp <= 0) {
+            _errors.push_back("Error (" + _filename + ") : shadow_rays must be positive");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // final_gather_rays
+    cout << "final_gather_rays" << "\t";
+    if (!subsection.FindValue("final_gather_rays")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["final_gather_rays"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative final_gather_rays");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // irradiance_cache_accuracy
+    cout << "irradiance_cache_accuracy" << "\t";
+    if (!subsection.FindValue("irradiance_cache_accuracy")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        double temp;
+        subsection["irradiance_cache_accuracy"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative irradiance_cache_accuracy");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // irradiance_photon_step
+    cout << "irradiance_photon_step" << "\t";
+    if (!subsection.FindValue("irradiance_photon_step")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["irradiance_photon_step"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative irradiance_photon_step");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // progressive_passes
+    cout << "progressive_passes" << "\t";
+    if (!subsection.FindValue("progressive_passes")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["progressive_passes"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative progressive_passes");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // threads
+    cout << "threads" << "\t";
+    if (!subsection.FindValue("threads")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["threads"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative number of threads");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
+    // seed
+    cout << "seed" << "\t";
+    if (!subsection.FindValue("seed")) {
+        cout << "OK (default)" << endl;
+    }
+    else {
+        int temp;
+        subsection["seed"] >> temp;
+        if (temp < 0) {
+            _errors.push_back("Error (" + _filename + ") : Negative seed");
+            well_formed = false;
+            cout << "ERR" << endl;
+        }
+        else cout << "OK" << endl;
+    }
+
     // photon_depth
     cout << "photon_depth" << "\t";
     if (!subsection.FindValue("photon_depth")) {
@@ -758,10 +942,47 @@ bool ParserYAML::check_all()
     return well_formed;
 }
 
+/**
+ * \brief Hashes a node and all its children
+ * \param node : the node to hash
+ * \param hash : the hash of what was hashed before
+ *
+ * Scalars are hashed as written in the file
+ */
+uint64_t ParserYAML::hash_node(const YAML::Node& node, uint64_t hash)
+{
+    std::string scalar;
+    unsigned char type = node.GetType();
+    hash = fnv1a(&type, 1, hash);
+
+    switch (node.GetType()) {
+        case YAML::CT_SCALAR :
+            node.GetScalar(scalar);
+            hash = fnv1a(scalar, hash);
+            break;
+        case YAML::CT_SEQUENCE :
+            for (YAML::Iterator it = node.begin(); it != node.end(); ++it)
+                hash = hash_node(*it, hash);
+            break;
+        case YAML::CT_MAP :
+            for (YAML::Iterator it = node.begin(); it != node.end(); ++it) {
+                hash = hash_node(it.first(), hash);
+                hash = hash_node(it.second(), hash);
+            }
+            break;
+        default :
+            break;
+    }
+    return hash;
+}
+
 /**
  * \brief Creates the scene corresponding to the SCENE section
  * described in the file
  * This function must only be used after a successfull call to is_well_formed()
+ *
+ * The scene also receives the hash of the description of its objects,
+ * textures and lights (not the camera)
  */
 Scene ParserYAML::generate_scene()
 {
@@ -784,14 +1005,36 @@ Scene ParserYAML::generate_scene()
     if (_root["SCENE"].FindValue("photon_depth")) global_param->set_photon_depth(_root["SCENE"]["photon_depth"]);
     if (_root["SCENE"].FindValue("raytracer_depth")) global_param->set_raytracer_depth(_root["SCENE"]["raytracer_depth"]);
     if (_root["SCENE"].FindValue("nb_photon_to_find")) global_param->set_nb_photon_to_find(_root["SCENE"]["nb_photon_to_find"]);
+    if (_root["SCENE"].FindValue("max_search_radius")) global_param->set_max_search_radius(_root["SCENE"]["max_search_radius"]);
+    if (_root["SCENE"].FindValue("nb_caustic_photon_MAX")) global_param->set_nb_caustic_photon_MAX(_root["SCENE"]["nb_caustic_photon_MAX"]);
+    if (_root["SCENE"].FindValue("nb_caustic_photon_to_find")) global_param->set_nb_caustic_photon_to_find(_root["SCENE"]["nb_caustic_photon_to_find"]);
+    if (_root["SCENE"].FindValue("direct_lighting")) global_param->set_direct_lighting(_root["SCENE"]["direct_lighting"]);
+    if (_root["SCENE"].FindValue("shadow_rays")) global_param->set_shadow_rays(_root["SCENE"]["shadow_rays"]);
+    if (_root["SCENE"].FindValue("final_gather_rays")) global_param->set_final_gather_rays(_root["SCENE"]["final_gather_rays"]);
+    if (_root["SCENE"].FindValue("irradiance_cache_accuracy")) global_param->set_irradiance_cache_accuracy(_root["SCENE"]["irradiance_cache_accuracy"]);
+    if (_root["SCENE"].FindValue("irradiance_photon_step")) global_param->set_irradiance_photon_step(_root["SCENE"]["irradiance_photon_step"]);
+    if (_root["SCENE"].FindValue("progressive_passes")) global_param->set_progressive_passes(_root["SCENE"]["progressive_passes"]);
+    if (_root["SCENE"].FindValue("threads")) global_param->set_threads(_root["SCENE"]["threads"]);
+    if (_root["SCENE"].FindValue("seed")) global_param->set_seed((int)_root["SCENE"]["seed"]);
 
     cout << "Resolution X : " << global_param->get_res_x() << endl;
     cout << "Resolution Y : " << global_param->get_res_y() << endl;
     cout << "Supersampling : " << global_param->get_supersampling() << endl;
     cout << "nb_photon_MAX : " << global_param->get_nb_photon_MAX() << endl;
     cout << "nb_photon_to_find : " << global_param->get_nb_photon_to_find() << endl;
+    cout << "max_search_radius : " << global_param->get_max_search_radius() << endl;
+    cout << "nb_caustic_photon_MAX : " << global_param->get_nb_caustic_photon_MAX() << endl;
+    cout << "nb_caustic_photon_to_find : " << global_param->get_nb_caustic_photon_to_find() << endl;
+    cout << "direct_lighting : " << global_param->get_direct_lighting() << endl;
+    cout << "shadow_rays : " << global_param->get_shadow_rays() << endl;
+    cout << "final_gather_rays : " << global_param->get_final_gather_rays() << endl;
+    cout << "irradiance_cache_accuracy : " << global_param->get_irradiance_cache_accuracy() << endl;
+    cout << "irradiance_photon_step : " << global_param->get_irradiance_photon_step() << endl;
+    cout << "progressive_passes : " << global_param->get_progressive_passes() << endl;
     cout << "photon_depth : " << global_param->get_photon_depth() << endl;
     cout << "raytracer_depth : " << global_param->get_raytracer_depth() << endl;
+    cout << "threads : " << global_param->get_threads() << endl;
+    cout << "seed : " << global_param->get_seed() << endl;
 
 
     cout << endl;
@@ -807,22 +1050,42 @@ Scene ParserYAML::generate_scene()
     map<string, Texture *> texture_map;
     map<string, Shape *> object_map;
     boost::shared_ptr<Shape> temp_shape;
+    uint64_t content_hash = FNV_OFFSET_BASIS;
     for (unsigned int i = 0; i < _root["SCENE"]["objects"].size(); i++) {
         _root["SCENE"]["objects"][i] >> object_name;
+        const YAML::Node& object_node = _object_list[object_name]->_root["OBJECTS"]["-"+object_name];
+        object_node["texture"] >> texture_name;
+        content_hash = hash_node(object_node, fnv1a(object_name, content_hash));
+        content_hash = hash_node(_texture_list[texture_name]->_root["TEXTURES"]["-"+texture_name], content_hash);
+
         cout << "Adding object\t" << object_name;
         scene.add_shape(temp_shape = _object_list[object_name]->create_object(object_name, texture_map));
         object_map[object_name] = temp_shape.get();
+
+        // A mesh is described by its file rather than by the YAML node
+        const TriangleMesh* mesh = dynamic_cast<const TriangleMesh*>(temp_shape.get());
+        if (mesh != NULL) {
+            const MeshData& data = mesh->get_data();
+            content_hash = fnv1a(&data.vertices[0], data.vertices.size() * sizeof(Point3D), content_hash);
+            if (!data.normals.empty())
+                content_hash = fnv1a(&data.normals[0], data.normals.size() * sizeof(Vector3D), content_hash);
+            content_hash = fnv1a(&data.indices[0], data.indices.size() * sizeof(unsigned int), content_hash);
+        }
         cout << endl;
     }
 
 // Lights
     for (unsigned int i = 0; i < _root["SCENE"]["lights"].size(); i++) {
         _root["SCENE"]["lights"][i] >> light_name;
+        content_hash = hash_node(_light_list[light_name]->_root["LIGHTS"]["-"+light_name], fnv1a(light_name, content_hash));
         cout << "Adding light\t" << light_name;
         scene.add_light(_light_list[light_name]->create_light(light_name, object_map));
         cout << endl;
     }
 
+    scene.set_content_hash(content_hash);
+    scene.build_acceleration_structure();
+
     cout << endl << "SCENE CREATED SUCCESSFULLY" << endl << endl;
 
     return scene;
@@ -949,6 +1212,31 @@ boost::shared_ptr<Shape> ParserYAML::create_object(std::string object_name, std:
 
         object = boost::shared_ptr<Shape>(new Triangle(absorb, reflect, transparency, texture, point1, point2, point3, for_volume));
     }
+    else if (object_type == "Mesh") {
+        double absorb = sub_root["absorb"];
+        double reflect = sub_root["reflect"];
+        double transparency = sub_root["transparency"];
+        string file = sub_root["file"];
+
+        MeshData data;
+        load_mesh(file, data);
+        cout << " from " << file << " (" << data.get_nb_triangles() << " triangles)";
+
+        // Optional placement of the mesh : scale first, then translation
+        double scale = 1.0;
+        Vector3D translation(0, 0, 0);
+        if (sub_root.FindValue("scale")) sub_root["scale"] >> scale;
+        if (sub_root.FindValue("translation"))
+            translation = Vector3D(sub_root["translation"][0], sub_root["translation"][1], sub_root["translation"][2]);
+        if (scale <= 0) {
+            cout << endl << "CRITICAL FAILURE : " << object_name << " : the scale of a mesh must be positive" << endl;
+            exit(EXIT_FAILURE);
+        }
+        for (unsigned int i = 0; i < data.vertices.size(); i++)
+            data.vertices[i] = scale * data.vertices[i] + translation;
+
+        object = boost::shared_ptr<Shape>(new TriangleMesh(absorb, reflect, transparency, texture, data));
+    }
     else {
         cout << endl << "CRITICAL FAILURE : It appears the type of item isn't specified for scene generation" << endl;
         exit(EXIT_FAILURE);
@@ -73,6 +73,7 @@ public :
     bool check_scene(); ///< Verifies the scene of the file (MASTER file)
 
     bool check_vector(const YAML::Node& vector); ///< Verifies that a given vector (parameter) is really a vector
+    static uint64_t hash_node(const YAML::Node& node, uint64_t hash); ///< Hashes a node and all its children, chained to the given hash
 //
 /**
  * \brief Shows all errors/warnings
@@ -0,0 +1,169 @@
+/**
+ * \file bvh.cpp
+ * \brief Implementation of class BVH
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include <algorithm>
+#include "bvh.hpp"
+
+static const unsigned int max_leaf_size = 4 ; ///< Leaves never hold more primitives than this when a split is possible
+static const unsigned int nb_bins = 12 ; ///< Number of buckets used to evaluate the surface area heuristic
+static const unsigned int max_sah_depth = 40 ; ///< Below this depth, median splits keep the traversal stack bounded
+static const double traversal_cost = 0.125 ; ///< Cost of visiting a node, relatively to intersecting a primitive
+
+/**
+ * \struct BVH::BuildEntry
+ * \brief A primitive as seen during the construction
+ */
+struct BVH::BuildEntry
+{
+	BoundingBox box ; ///< Bounding box of the primitive
+	Point3D centroid ; ///< Center of its bounding box
+	unsigned int index ; ///< Index of the primitive given to build()
+	unsigned int depth ; ///< Depth of the node being built (only meaningful in the first entry of a range)
+};
+
+/**
+ * \brief Functor ordering entries by centroid along an axis
+ */
+struct CentroidLess
+{
+	CentroidLess(int axis) : _axis(axis) {}
+	template <typename T> bool operator()(const T& a, const T& b) const { return a.centroid[_axis] < b.centroid[_axis] ; }
+	int _axis ;
+};
+
+/**
+ * \param boxes : the bounding boxes of the primitives, the
+ * position of each box in this list being its primitive index
+ *
+ * Builds and flattens the hierarchy
+ */
+void BVH::build(const std::vector<BoundingBox>& boxes)
+{
+	_nodes.clear();
+	_indices.clear();
+	if (boxes.empty()) return;
+
+	std::vector<BuildEntry> entries(boxes.size());
+	for (unsigned int i = 0; i < boxes.size(); i++) {
+		entries[i].box = boxes[i];
+		entries[i].centroid = boxes[i].get_centroid();
+		entries[i].index = i;
+	}
+	entries[0].depth = 0;
+
+	_nodes.reserve(2*boxes.size());
+	_indices.reserve(boxes.size());
+	build_recursive(entries, 0, entries.size());
+}
+
+/**
+ * \param entries : the primitives being sorted into the hierarchy
+ * \param begin, end : the range of entries to put under the new node
+ *
+ * Uses a binned surface area heuristic along the axis where the centroids
+ * are the most spread, and makes a leaf when no split is cheaper than
+ * intersecting all the primitives
+ */
+unsigned int BVH::build_recursive(std::vector<BuildEntry>& entries, unsigned int begin, unsigned int end)
+{
+	unsigned int depth = entries[begin].depth;
+	unsigned int node_index = _nodes.size();
+	_nodes.push_back(Node());
+
+	BoundingBox box, centroid_box;
+	for (unsigned int i = begin; i < end; i++) {
+		box.extend(entries[i].box);
+		centroid_box.extend(entries[i].centroid);
+	}
+	_nodes[node_index].box = box;
+
+	unsigned int nb_primitives = end - begin;
+	int axis = centroid_box.get_largest_axis();
+	double extent = centroid_box.get_max()[axis] - centroid_box.get_min()[axis];
+
+	if (nb_primitives <= 1 || (extent <= 0.0 && nb_primitives <= max_leaf_size)) {
+		_nodes[node_index].offset = _indices.size();
+		_nodes[node_index].nb_primitives = nb_primitives;
+		_nodes[node_index].axis = 0;
+		for (unsigned int i = begin; i < end; i++)
+			_indices.push_back(entries[i].index);
+		return node_index;
+	}
+
+	unsigned int middle = begin + nb_primitives/2;
+
+	if (extent > 0.0 && depth < max_sah_depth) {
+		// Binned surface area heuristic
+		unsigned int bin_count[nb_bins] = { 0 };
+		BoundingBox bin_box[nb_bins];
+		double bin_scale = nb_bins / extent;
+		double axis_min = centroid_box.get_min()[axis];
+
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int b = (unsigned int)((entries[i].centroid[axis] - axis_min) * bin_scale);
+			if (b >= nb_bins) b = nb_bins - 1;
+			bin_count[b]++;
+			bin_box[b].extend(entries[i].box);
+		}
+
+		double best_cost = -1.0;
+		unsigned int best_split = 0;
+		for (unsigned int split = 0; split < nb_bins - 1; split++) {
+			BoundingBox left, right;
+			unsigned int nb_left = 0, nb_right = 0;
+			for (unsigned int b = 0; b <= split; b++) {
+				left.extend(bin_box[b]);
+				nb_left += bin_count[b];
+			}
+			for (unsigned int b = split + 1; b < nb_bins; b++) {
+				right.extend(bin_box[b]);
+				nb_right += bin_count[b];
+			}
+			if (nb_left == 0 || nb_right == 0) continue;
+
+			double cost = traversal_cost
+				+ (nb_left * left.get_surface_area() + nb_right * right.get_surface_area()) / box.get_surface_area();
+			if (best_cost < 0.0 || cost < best_cost) {
+				best_cost = cost;
+				best_split = split;
+			}
+		}
+
+		if (best_cost >= 0.0 && best_cost >= nb_primitives && nb_primitives <= max_leaf_size) {
+			_nodes[node_index].offset = _indices.size();
+			_nodes[node_index].nb_primitives = nb_primitives;
+			_nodes[node_index].axis = axis;
+			for (unsigned int i = begin; i < end; i++)
+				_indices.push_back(entries[i].index);
+			return node_index;
+		}
+
+		if (best_cost >= 0.0) {
+			unsigned int i = begin, j = end;
+			while (i < j) {
+				unsigned int b = (unsigned int)((entries[i].centroid[axis] - axis_min) * bin_scale);
+				if (b >= nb_bins) b = nb_bins - 1;
+				if (b <= best_split) i++;
+				else std::swap(entries[i], entries[--j]);
+			}
+			middle = i;
+		}
+		else
+			std::nth_element(entries.begin() + begin, entries.begin() + middle, entries.begin() + end, CentroidLess(axis));
+	}
+	else
+		std::nth_element(entries.begin() + begin, entries.begin() + middle, entries.begin() + end, CentroidLess(axis));
+
+	entries[begin].depth = depth + 1;
+	entries[middle].depth = depth + 1;
+
+	_nodes[node_index].nb_primitives = 0;
+	_nodes[node_index].axis = axis;
+	build_recursive(entries, begin, middle);
+	_nodes[node_index].offset = build_recursive(entries, middle, end);
+
+	return node_index;
+}
@@ -0,0 +1,196 @@
+#ifndef BVH_HPP_
+#define BVH_HPP_
+
+/**
+ * \file bvh.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of class BVH
+ */
+
+#include <vector>
+#include "shapes/bounding_box.hpp"
+#include "launchables/launchable.hpp"
+
+/**
+ * \class BVH
+ * \brief Bounding volume hierarchy over a list of bounding boxes
+ *
+ * The hierarchy is built once with the surface area heuristic,
+ * then flattened into a contiguous array of nodes in depth-first
+ * order : the first child of a node always follows it, only the
+ * second child has to be stored.
+ * It only knows primitives by their index in the list of boxes
+ * given to build(), the caller intersects them during traverse().
+ */
+class BVH
+{
+public:
+	/**
+	 * \struct Node
+	 * \brief A flattened node of the hierarchy
+	 */
+	struct Node
+	{
+		BoundingBox box ; ///< Box enclosing all the primitives below this node
+		unsigned int offset ; ///< Leaf : first primitive in the index list. Interior : index of the second child
+		unsigned short nb_primitives ; ///< Number of primitives of a leaf, 0 for an interior node
+		unsigned short axis ; ///< Axis along which the children were split
+	};
+
+	BVH() {} ///< Empty hierarchy
+
+	void build(const std::vector<BoundingBox>& boxes) ; ///< Builds the hierarchy over the given boxes
+
+	bool is_empty() const { return _nodes.empty() ; } ///< Returns whether no primitive was given to build()
+	const std::vector<Node>& get_nodes() const { return _nodes ; } ///< Returns the flattened nodes
+	const std::vector<unsigned int>& get_indices() const { return _indices ; } ///< Returns the primitive indices referenced by the leaves
+
+	/**
+	 * \brief Walks the hierarchy along a launchable
+	 * \param l : the launchable going through the hierarchy
+	 * \param t_max : distance beyond which nodes are skipped, lowered by the intersector
+	 * \param intersector : functor called as intersector(primitive_index, t_max) on
+	 * each primitive of each reached leaf, it lowers t_max when it finds a nearer hit
+	 *
+	 * The nodes the launchable leaves before its t_min are skipped too.
+	 * Nearest children are visited first so that t_max shrinks as early as possible.
+	 * The walk stops as soon as t_max drops to t_min : nothing can be nearer, and an
+	 * any-hit intersector ends the query this way at the first primitive hit
+	 */
+	template <typename Intersector>
+	void traverse(const Launchable& l, double& t_max, Intersector& intersector) const
+	{
+		if (_nodes.empty()) return;
+
+		const Point3D& start = l.get_end_point();
+		const Vector3D& dir = l.get_direction();
+		double t_min = l.get_t_min();
+		Vector3D inv_dir(1.0/dir[0], 1.0/dir[1], 1.0/dir[2]);
+		bool dir_is_neg[3] = { inv_dir[0] < 0, inv_dir[1] < 0, inv_dir[2] < 0 };
+
+		unsigned int to_visit[64];
+		int nb_to_visit = 0;
+		unsigned int current = 0;
+
+		while (true) {
+			const Node& node = _nodes[current];
+			if (node.box.is_intersected_by(start, inv_dir, t_min, t_max)) {
+				if (node.nb_primitives > 0) {
+					for (unsigned int i = 0; i < node.nb_primitives; i++)
+						intersector(_indices[node.offset + i], t_max);
+					if (nb_to_visit == 0 || t_max <= t_min) break;
+					current = to_visit[--nb_to_visit];
+				}
+				else if (dir_is_neg[node.axis]) {
+					to_visit[nb_to_visit++] = current + 1;
+					current = node.offset;
+				}
+				else {
+					to_visit[nb_to_visit++] = node.offset;
+					current = current + 1;
+				}
+			}
+			else {
+				if (nb_to_visit == 0) break;
+				current = to_visit[--nb_to_visit];
+			}
+		}
+	}
+
+	/**
+	 * \brief Walks the hierarchy along the launchables of a packet
+	 * \param packet : the launchables going through the hierarchy together
+	 * \param t_max : distance of each lane beyond which nodes are skipped, lowered by the intersector
+	 * \param intersector : functor called as intersector(primitive_index, t_max, lanes) on
+	 * each primitive of each reached leaf, lanes being the launchables which reached it
+	 *
+	 * A node is entered as soon as one lane reaches it. The packet is meant
+	 * to be coherent : the children are visited in the order of its first launchable
+	 */
+	template <typename Intersector>
+	void traverse_packet(const RayPacket& packet, Double4& t_max, Intersector& intersector) const
+	{
+		if (_nodes.empty()) return;
+
+		bool dir_is_neg[3];
+		for (int a = 0; a < 3; a++)
+			dir_is_neg[a] = (packet.inv_direction[a] < Double4(0.0)).mask() & 1;
+
+		unsigned int to_visit[64];
+		int nb_to_visit = 0;
+		unsigned int current = 0;
+
+		while (true) {
+			const Node& node = _nodes[current];
+			int lanes = node.box.is_intersected_by(packet, t_max);
+			if (lanes != 0) {
+				if (node.nb_primitives > 0) {
+					for (unsigned int i = 0; i < node.nb_primitives; i++)
+						intersector(_indices[node.offset + i], t_max, lanes);
+					if (nb_to_visit == 0) break;
+					current = to_visit[--nb_to_visit];
+				}
+				else if (dir_is_neg[node.axis]) {
+					to_visit[nb_to_visit++] = current + 1;
+					current = node.offset;
+				}
+				else {
+					to_visit[nb_to_visit++] = node.offset;
+					current = current + 1;
+				}
+			}
+			else {
+				if (nb_to_visit == 0) break;
+				current = to_visit[--nb_to_visit];
+			}
+		}
+	}
+
+	/**
+	 * \brief Finds the primitives whose box contains a point
+	 * \param point : the point to locate
+	 * \param visitor : functor called as visitor(primitive_index) on each
+	 * primitive of each leaf whose box contains the point
+	 *
+	 * The boxes of the primitives themselves are not tested, the visitor does
+	 */
+	template <typename Visitor>
+	void visit_containing(const Point3D& point, Visitor& visitor) const
+	{
+		if (_nodes.empty()) return;
+
+		unsigned int to_visit[64];
+		int nb_to_visit = 0;
+		unsigned int current = 0;
+
+		while (true) {
+			const Node& node = _nodes[current];
+			if (node.box.contains(point)) {
+				if (node.nb_primitives > 0) {
+					for (unsigned int i = 0; i < node.nb_primitives; i++)
+						visitor(_indices[node.offset + i]);
+					if (nb_to_visit == 0) break;
+					current = to_visit[--nb_to_visit];
+				}
+				else {
+					to_visit[nb_to_visit++] = node.offset;
+					current = current + 1;
+				}
+			}
+			else {
+				if (nb_to_visit == 0) break;
+				current = to_visit[--nb_to_visit];
+			}
+		}
+	}
+
+private:
+	struct BuildEntry ;
+
+	unsigned int build_recursive(std::vector<BuildEntry>& entries, unsigned int begin, unsigned int end) ; ///< Builds the subtree of entries [begin, end) and returns its node index
+
+	std::vector<Node> _nodes ; ///< Flattened nodes, the root being the first one
+	std::vector<unsigned int> _indices ; ///< Primitive indices, each leaf owns a contiguous range
+};
+
+#endif /* BVH_HPP_ */
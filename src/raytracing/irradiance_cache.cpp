@@ -0,0 +1,86 @@
+/**
+ * \file irradiance_cache.cpp
+ * \brief Implementation of class IrradianceCache
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include <algorithm>
+#include <cmath>
+#include "irradiance_cache.hpp"
+
+/**
+ * \brief Sums the weighted irradiance of the records around a point
+ */
+struct RecordInterpolator
+{
+	RecordInterpolator(const std::vector<IrradianceRecord>& records, const Point3D& point,
+		const Vector3D& normal, double accuracy) :
+			_records(records), _point(point), _normal(normal), _min_weight(1.0 / accuracy),
+			_r(0.0), _g(0.0), _b(0.0), _sum_weights(0.0) {}
+
+	void operator()(unsigned int index)
+	{
+		const IrradianceRecord& record = _records[index] ;
+
+		double cos_normals = std::min(1.0, _normal.dot(record.normal)) ;
+		if (cos_normals <= 0.0) return ;
+
+		double error = (_point - record.position).norm() / record.harmonic_distance
+			+ sqrt(1.0 - cos_normals) ;
+		if (error * _min_weight >= 1.0) return ;
+
+		// Records just behind the point saw another part of the scene
+		double in_front = (_point - record.position).dot(0.5 * (_normal + record.normal)) ;
+		if (in_front < -0.01 * record.harmonic_distance) return ;
+
+		double weight = (error > 0.0) ? 1.0 / error : 1.0e10 ;
+		_r += weight * record.irradiance.get_r() ;
+		_g += weight * record.irradiance.get_g() ;
+		_b += weight * record.irradiance.get_b() ;
+		_sum_weights += weight ;
+	}
+
+	const std::vector<IrradianceRecord>& _records ; ///< All the records of the cache
+	Point3D _point ; ///< Where the irradiance is interpolated
+	Vector3D _normal ; ///< Normal at this point
+	double _min_weight ; ///< 1 / accuracy
+	double _r, _g, _b ; ///< Weighted sum of the irradiances
+	double _sum_weights ; ///< Sum of the weights
+};
+
+/**
+ * \param records : the records computed during the last pass
+ *
+ * The sphere of influence of a record has a radius of accuracy * R,
+ * beyond which its weight is always below 1 / accuracy
+ */
+void IrradianceCache::add(const std::vector<IrradianceRecord>& records)
+{
+	if (records.empty()) return ;
+	_records.insert(_records.end(), records.begin(), records.end()) ;
+
+	std::vector<BoundingBox> boxes ;
+	boxes.reserve(_records.size()) ;
+	for (unsigned int i = 0; i < _records.size(); i++) {
+		Vector3D radius = Vector3D::Constant(_accuracy * _records[i].harmonic_distance) ;
+		boxes.push_back(BoundingBox(_records[i].position - radius, _records[i].position + radius)) ;
+	}
+	_bvh.build(boxes) ;
+}
+
+/**
+ * \param point : where the illumination is needed
+ * \param normal : the normal at this point, on the side of the viewer
+ * \param irradiance : filled with the weighted mean of the records if there is any
+ */
+bool IrradianceCache::interpolate(const Point3D& point, const Vector3D& normal, Color& irradiance) const
+{
+	RecordInterpolator interpolator(_records, point, normal, _accuracy) ;
+	_bvh.visit_containing(point, interpolator) ;
+
+	if (interpolator._sum_weights <= 0.0) return false ;
+
+	double inv_sum = 1.0 / interpolator._sum_weights ;
+	irradiance = Color(interpolator._r * inv_sum, interpolator._g * inv_sum, interpolator._b * inv_sum) ;
+	return true ;
+}
@@ -0,0 +1,69 @@
+#ifndef IRRADIANCE_CACHE_HPP_
+#define IRRADIANCE_CACHE_HPP_
+
+/**
+ * \file irradiance_cache.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of class IrradianceCache
+ */
+
+#include <vector>
+#include "geometry.hpp"
+#include "color.hpp"
+#include "bvh.hpp"
+
+/**
+ * \struct IrradianceRecord
+ * \brief Indirect illumination gathered at a point, reused around it
+ */
+struct IrradianceRecord
+{
+	/**
+	 * \brief Constructor
+	 * \param pos : where the illumination was gathered
+	 * \param norm : the normal at this point, on the side of the viewer
+	 * \param irr : the gathered illumination
+	 * \param dist : harmonic mean of the distances to the surfaces seen by the gathering rays
+	 */
+	IrradianceRecord(const Point3D& pos, const Vector3D& norm, const Color& irr, double dist) :
+		position(pos), normal(norm), irradiance(irr), harmonic_distance(dist) {}
+
+	Point3D position ; ///< Where the illumination was gathered
+	Vector3D normal ; ///< Normal at this point
+	Color irradiance ; ///< Gathered illumination
+	double harmonic_distance ; ///< Harmonic mean of the distances to the surfaces seen from the point
+};
+
+/**
+ * \class IrradianceCache
+ * \brief Ward's irradiance cache : interpolates the illumination gathered at nearby points
+ *
+ * A record of illumination gathered at p with normal np weights a point x
+ * of normal n by 1 / (|x - p| / R + sqrt(1 - n.np)), R being the harmonic
+ * mean distance of the record : it is used if this weight exceeds
+ * 1 / accuracy. Records close to other surfaces thus cover a small area.
+ *
+ * The cache is filled between the rendering passes and only read during
+ * them : add() rebuilds a BVH over the spheres of influence of the
+ * records, so that any number of threads can interpolate() at once.
+ */
+class IrradianceCache
+{
+public:
+	/**
+	 * \brief Constructor of an empty cache
+	 * \param accuracy : the maximal error allowed, smaller values give more records
+	 */
+	IrradianceCache(double accuracy) : _accuracy(accuracy) {}
+
+	void add(const std::vector<IrradianceRecord>& records) ; ///< Adds records to the cache, not to be called while interpolating
+	bool interpolate(const Point3D& point, const Vector3D& normal, Color& irradiance) const ; ///< Interpolates the illumination at a point from the records around it, returns false if there is none
+	unsigned int get_nb_records() const { return _records.size() ; } ///< Returns the number of records in the cache
+
+private:
+	double _accuracy ; ///< Maximal error allowed
+	std::vector<IrradianceRecord> _records ; ///< All the records
+	BVH _bvh ; ///< Hierarchy over the boxes bounding the sphere of influence of each record
+};
+
+#endif /* IRRADIANCE_CACHE_HPP_ */
@@ -0,0 +1,137 @@
+#ifndef NEAREST_PHOTONS_HPP_
+#define NEAREST_PHOTONS_HPP_
+
+/**
+ * \file nearest_photons.hpp
+ * \author T.FEIGLER / B.BORGOBELLO
+ * \brief Declaration of class NearestPhotons
+ */
+
+#include <vector>
+#include <limits>
+#include "geometry.hpp"
+
+/**
+ * \class NearestPhotons
+ * \brief Result of a k-nearest photons search
+ *
+ * Holds up to k photon indices with their squared distance to the
+ * searched point. Once k photons are found they are kept in a max-heap
+ * so that the farthest one is replaced first and the search radius shrinks.
+ * The storage is allocated once, an instance is meant to be reused by
+ * one thread for all its searches.
+ */
+class NearestPhotons
+{
+public:
+	NearestPhotons() : _max(0), _found(0), _got_heap(false), _max_dist2(0.0) {} ///< Empty result, reset() must be called before searching
+
+	/**
+	 * \brief Prepares a new search
+	 * \param point : the center of the search
+	 * \param k : the maximum number of photons to find
+	 * \param max_distance : photons farther than this are ignored, 0 for no limit
+	 */
+	void reset(const Point3D& point, unsigned int k, double max_distance = 0.0)
+	{
+		_point = point ;
+		_max = k ;
+		_found = 0 ;
+		_got_heap = false ;
+		_max_dist2 = (max_distance > 0.0) ? max_distance * max_distance : std::numeric_limits<double>::max() ;
+		if (_index.size() < k) {
+			_index.resize(k) ;
+			_dist2.resize(k) ;
+		}
+	}
+
+	const Point3D& get_point() const { return _point ; } ///< Returns the center of the search
+	unsigned int get_nb_found() const { return _found ; } ///< Returns the number of photons found
+	unsigned int get_index(unsigned int i) const { return _index[i] ; } ///< Returns the index in the photon map of the i-th photon found
+	double get_squared_distance(unsigned int i) const { return _dist2[i] ; } ///< Returns the squared distance of the i-th photon found
+	double get_search_squared_distance() const { return _max_dist2 ; } ///< Returns the squared radius beyond which photons are rejected
+
+	/**
+	 * \brief Returns the squared radius of the sphere enclosing the photons found
+	 */
+	double get_max_squared_distance() const
+	{
+		if (_got_heap) return _dist2[0] ;
+
+		double max_dist2 = 0.0 ;
+		for (unsigned int i = 0; i < _found; i++)
+			if (_dist2[i] > max_dist2) max_dist2 = _dist2[i] ;
+		return max_dist2 ;
+	}
+
+	/**
+	 * \brief Proposes a photon closer than the search radius
+	 * \param index : index of the photon in the photon map
+	 * \param dist2 : its squared distance to the center of the search
+	 */
+	void add(unsigned int index, double dist2)
+	{
+		if (_max == 0) return ;
+
+		if (_found < _max) {
+			_index[_found] = index ;
+			_dist2[_found] = dist2 ;
+			_found++ ;
+			if (_found == _max) {
+				build_heap() ;
+				_max_dist2 = _dist2[0] ;
+			}
+			return ;
+		}
+
+		// Replaces the farthest photon and sifts it down the max-heap
+		unsigned int parent = 0 ;
+		unsigned int child = 1 ;
+		while (child < _found) {
+			if (child + 1 < _found && _dist2[child + 1] > _dist2[child]) child++ ;
+			if (dist2 >= _dist2[child]) break ;
+			_dist2[parent] = _dist2[child] ;
+			_index[parent] = _index[child] ;
+			parent = child ;
+			child = 2 * parent + 1 ;
+		}
+		_dist2[parent] = dist2 ;
+		_index[parent] = index ;
+		_max_dist2 = _dist2[0] ;
+	}
+
+private:
+	/**
+	 * \brief Orders the photons found as a max-heap on their distance
+	 */
+	void build_heap()
+	{
+		for (int i = (int)_found / 2 - 1; i >= 0; i--) {
+			unsigned int parent = i ;
+			double dist2 = _dist2[parent] ;
+			unsigned int index = _index[parent] ;
+			unsigned int child = 2 * parent + 1 ;
+			while (child < _found) {
+				if (child + 1 < _found && _dist2[child + 1] > _dist2[child]) child++ ;
+				if (dist2 >= _dist2[child]) break ;
+				_dist2[parent] = _dist2[child] ;
+				_index[parent] = _index[child] ;
+				parent = child ;
+				child = 2 * parent + 1 ;
+			}
+			_dist2[parent] = dist2 ;
+			_index[parent] = index ;
+		}
+		_got_heap = true ;
+	}
+
+	Point3D _point ; ///< Center of the search
+	unsigned int _max ; ///< Maximum number of photons to find
+	unsigned int _found ; ///< Number of photons found so far
+	bool _got_heap ; ///< Whether the photons found are ordered as a max-heap
+	double _max_dist2 ; ///< Current squared search radius
+	std::vector<unsigned int> _index ; ///< Indices of the photons found
+	std::vector<double> _dist2 ; ///< Squared distances of the photons found
+};
+
+#endif /* NEAREST_PHOTONS_HPP_ */
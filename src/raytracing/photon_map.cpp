@@ -0,0 +1,295 @@
+/**
+ * \file photon_map.cpp
+ * \brief Implementation of class PhotonMap
+ * \author T.FEIGLER / B.BORGOBELLO
+ */
+
+#include <algorithm>
+#include <cstring>
+#include "photon_map.hpp"
+
+/**
+ * \brief Functor ordering photons along an axis
+ */
+struct PhotonAxisLess
+{
+	PhotonAxisLess(int axis) : _axis(axis) {}
+	bool operator()(const StoredPhoton& a, const StoredPhoton& b) const { return a.position[_axis] < b.position[_axis] ; }
+	int _axis ;
+};
+
+/**
+ * \param list : the photons whose spread is measured
+ * \param begin, end : the photons considered
+ *
+ * Returns the axis (0, 1 or 2) along which the photons are the most spread
+ */
+static int get_widest_axis(const std::vector<StoredPhoton>& list, unsigned int begin, unsigned int end)
+{
+    float min[3], max[3];
+    for (int a = 0; a < 3; a++)
+        min[a] = max[a] = list[begin].position[a];
+    for (unsigned int i = begin + 1; i < end; i++)
+        for (int a = 0; a < 3; a++) {
+            if (list[i].position[a] < min[a]) min[a] = list[i].position[a];
+            if (list[i].position[a] > max[a]) max[a] = list[i].position[a];
+        }
+
+    int axis = 0;
+    if (max[1] - min[1] > max[axis] - min[axis]) axis = 1;
+    if (max[2] - min[2] > max[axis] - min[axis]) axis = 2;
+    return axis;
+}
+
+/**
+ * \param list : the photons to sort in the map, emptied
+ */
+PhotonMap::PhotonMap(std::vector<StoredPhoton>& list)
+{
+    std::cout << "Balancing the photon KD-Tree..." << std::endl ;
+    if (!list.empty())
+        sort_buckets(list, 0, list.size()) ;
+    _photons.swap(list) ;
+    index_photons() ;
+    std::cout << "Optimization done." << std::endl ;
+}
+
+/**
+ * \param list : the photons being sorted, reordered in place
+ * \param begin, end : the photons of the subtree
+ *
+ * The photons are split along the axis where they are the most spread :
+ * the first half is below the middle photon, the second half above
+ */
+void PhotonMap::sort_buckets(std::vector<StoredPhoton>& list, unsigned int begin, unsigned int end)
+{
+    if (end - begin <= BUCKET_SIZE) return;
+
+    int axis = get_widest_axis(list, begin, end);
+    unsigned int middle = begin + (end - begin) / 2;
+    std::nth_element(list.begin() + begin, list.begin() + middle, list.begin() + end, PhotonAxisLess(axis));
+
+    sort_buckets(list, begin, middle);
+    sort_buckets(list, middle, end);
+}
+
+/**
+ * \param node : index of the node
+ * \param begin, end : the photons of the subtree, already sorted by sort_buckets()
+ *
+ * Finds again the axis sort_buckets() split along : the splitting plane
+ * is the smallest coordinate of the second half. The nodes only depend
+ * on the order of the photons, which is all a saved map needs to keep.
+ */
+void PhotonMap::build_nodes(unsigned int node, unsigned int begin, unsigned int end)
+{
+    if (end - begin <= BUCKET_SIZE) return;
+
+    int axis = get_widest_axis(_photons, begin, end);
+    unsigned int middle = begin + (end - begin) / 2;
+    float split = _photons[middle].position[axis];
+    for (unsigned int i = middle + 1; i < end; i++)
+        split = std::min(split, _photons[i].position[axis]);
+
+    if (node >= _split.size()) {
+        _split.resize(node + 1);
+        _axis.resize(node + 1);
+    }
+    _split[node] = split;
+    _axis[node] = axis;
+
+    build_nodes(2 * node + 1, begin, middle);
+    build_nodes(2 * node + 2, middle, end);
+}
+
+/**
+ * The position arrays get BUCKET_SIZE extra photons far away,
+ * read by search_bucket() but never part of a bucket
+ */
+void PhotonMap::index_photons()
+{
+    _split.clear();
+    _axis.clear();
+    if (!_photons.empty())
+        build_nodes(0, 0, _photons.size());
+
+    unsigned int padded = _photons.size() + BUCKET_SIZE;
+    _x.assign(padded, std::numeric_limits<float>::max());
+    _y.assign(padded, std::numeric_limits<float>::max());
+    _z.assign(padded, std::numeric_limits<float>::max());
+    for (unsigned int i = 0; i < _photons.size(); i++) {
+        _x[i] = _photons[i].position[0];
+        _y[i] = _photons[i].position[1];
+        _z[i] = _photons[i].position[2];
+    }
+}
+
+/**
+ * \param np : the search being done
+ * \param node : root of the subtree to search
+ * \param begin, end : the photons of the subtree
+ *
+ * The side of the splitting plane containing the point is searched
+ * first, the other one only if the plane is within the search radius.
+ * In a bucket, the distances to all its photons are computed at once,
+ * the search radius is then checked again as it shrinks with each photon added
+ */
+void PhotonMap::locate_photons(NearestPhotons& np, unsigned int node, unsigned int begin, unsigned int end) const
+{
+    const Point3D& point = np.get_point();
+
+    if (end - begin <= BUCKET_SIZE) {
+        float dist2[BUCKET_SIZE];
+        int within = search_bucket(point, np.get_search_squared_distance(), false, begin, end, dist2);
+        for (unsigned int i = 0; within != 0; i++, within >>= 1)
+            if ((within & 1) && dist2[i] < np.get_search_squared_distance())
+                np.add(begin + i, dist2[i]);
+        return;
+    }
+
+    unsigned int middle = begin + (end - begin) / 2;
+    double delta = point[_axis[node]] - _split[node];
+
+    if (delta > 0) {
+        locate_photons(np, 2 * node + 2, middle, end);
+        if (delta * delta < np.get_search_squared_distance())
+            locate_photons(np, 2 * node + 1, begin, middle);
+    }
+    else {
+        locate_photons(np, 2 * node + 1, begin, middle);
+        if (delta * delta < np.get_search_squared_distance())
+            locate_photons(np, 2 * node + 2, middle, end);
+    }
+}
+
+/**
+ * \param point : where the flux is estimated
+ * \param nb_to_find : the number of photons to gather
+ * \param nb_emitted : the number of photons emitted to build the map
+ * \param max_distance : photons farther than this are ignored, 0 for no limit
+ * \param np : storage reused by all the photon searches
+ *
+ * Sums the power of the nearest photons, each photon carrying
+ * 1/nb_emitted of the power of its light, over the squared
+ * radius of the gathering sphere
+ */
+Color PhotonMap::estimate_flux(const Point3D& point, int nb_to_find, int nb_emitted, double max_distance, NearestPhotons& np) const
+{
+    np.reset(point, nb_to_find, max_distance) ;
+    get_k_nearest(np) ;
+
+    double r_, g_, b_ ;
+    r_ = g_ = b_ = 0.0 ;
+    for (unsigned int i = 0 ; i < np.get_nb_found() ; i++)
+    {
+        // TODO : verify the coherence of the flux calculated
+        Color ph_color = _photons[np.get_index(i)].get_power() ;
+        r_ += ph_color.get_r() ;
+        g_ += ph_color.get_g() ;
+        b_ += ph_color.get_b() ;
+    }
+
+    double inner_photon_power = 1.0 / nb_emitted ;
+
+    double furthest_distance_2 = np.get_max_squared_distance() ;
+    if (furthest_distance_2 <= 0.0)
+        return Color(0.0, 0.0, 0.0) ;
+
+    double flux_coef = inner_photon_power / furthest_distance_2 ;
+    return Color(r_ * flux_coef, g_ * flux_coef, b_ * flux_coef) ;
+}
+
+/**
+ * \param point : where the power is looked up
+ * \param max_distance : photons farther than this are ignored, 0 for no limit
+ * \param np : storage reused by all the photon searches
+ *
+ * A single nearest neighbour search, for the maps whose photons
+ * carry a precomputed flux (StoredPhoton::IRRADIANCE)
+ */
+Color PhotonMap::get_nearest_power(const Point3D& point, double max_distance, NearestPhotons& np) const
+{
+    np.reset(point, 1, max_distance) ;
+    get_k_nearest(np) ;
+
+    if (np.get_nb_found() == 0)
+        return Color(0.0, 0.0, 0.0) ;
+    return _photons[np.get_index(0)].get_power() ;
+}
+
+/**
+ * \struct PhotonMapFileHeader
+ * \brief 32 bytes written before each photon map of a file, followed by its photons in bucket order
+ */
+struct PhotonMapFileHeader
+{
+	char magic[4] ; ///< Always "PMAP"
+	uint32_t version ; ///< PHOTON_MAP_FILE_VERSION, also tells a file written with the other byte order
+	uint64_t key ; ///< Hash of everything the photons depend on
+	uint32_t photon_size ; ///< sizeof(StoredPhoton)
+	uint32_t reserved ; ///< Zero, keeps the photons aligned on 8 bytes
+	uint64_t nb_photons ; ///< Number of photons following the header
+};
+
+static const uint32_t PHOTON_MAP_FILE_VERSION = 3 ; ///< To be increased whenever StoredPhoton or the balancing changes
+
+/**
+ * \param stream : the binary stream to write into, several maps can follow each other
+ * \param key : hash of the scene and of the photon parameters
+ *
+ * The photons are written as they are in memory, already sorted,
+ * so that loading them is a single read (or a mapping of the file)
+ * followed by a pass over the photons to find the splitting planes.
+ * Returns false if the stream could not be written
+ */
+bool PhotonMap::save(std::ostream& stream, uint64_t key) const
+{
+    PhotonMapFileHeader header ;
+    std::memcpy(header.magic, "PMAP", 4) ;
+    header.version = PHOTON_MAP_FILE_VERSION ;
+    header.key = key ;
+    header.photon_size = sizeof(StoredPhoton) ;
+    header.reserved = 0 ;
+    header.nb_photons = _photons.size() ;
+
+    stream.write((const char *)&header, sizeof(header)) ;
+    if (!_photons.empty())
+        stream.write((const char *)&_photons[0], _photons.size() * sizeof(StoredPhoton)) ;
+
+    return (bool)stream ;
+}
+
+/**
+ * \param stream : the binary stream to read from, left after the photons
+ * \param key : hash of the scene and of the photon parameters
+ *
+ * Returns the photon map stored in the stream, or NULL if it
+ * can not be read, was written by another version or for another
+ * scene (other key)
+ */
+PhotonMap * PhotonMap::load(std::istream& stream, uint64_t key)
+{
+    PhotonMapFileHeader header ;
+    stream.read((char *)&header, sizeof(header)) ;
+    if (!stream || std::memcmp(header.magic, "PMAP", 4) != 0
+            || header.version != PHOTON_MAP_FILE_VERSION || header.photon_size != sizeof(StoredPhoton)) {
+        std::cout << "Not a photon map file of this version" << std::endl ;
+        return NULL ;
+    }
+    if (header.key != key) {
+        std::cout << "The photon map was built for another scene or other photon parameters" << std::endl ;
+        return NULL ;
+    }
+
+    PhotonMap *map = new PhotonMap() ;
+    map->_photons.resize(header.nb_photons) ;
+    if (header.nb_photons > 0)
+        stream.read((char *)&map->_photons[0], header.nb_photons * sizeof(StoredPhoton)) ;
+    if (!stream) {
+        std::cout << "The photon map file is truncated" << std::endl ;
+        delete map ;
+        return NULL ;
+    }
+    map->index_photons() ;
+    return map ;
+}
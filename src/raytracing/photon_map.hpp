@@ -7,92 +7,140 @@
  * \brief Declaration of class PhotonMap
  */
 
+#include <algorithm>
+#include <iostream>
+#include <limits>
 #include <vector>
 #include <cstdlib>
-#include <boost/smart_ptr/shared_ptr.hpp>
-#define LIBSSRCKDTREE_HAVE_BOOST
-#include <ssrc/spatial/kd_tree.h>
-#include "launchables/photon.hpp"
+#include <stdint.h>
+#include "color.hpp"
+#include "simd.hpp"
+#include "stored_photon.hpp"
+#include "nearest_photons.hpp"
 
 
 /**
  * \class PhotonMap
  * \brief Determines efficiently the k-nearest-neighbour at a given point
+ *
+ * The photons are kept by value in one contiguous array, sorted into
+ * buckets of at most BUCKET_SIZE photons by a kd-tree : a node covering
+ * the photons [begin, end) splits them at the middle, its children
+ * being at 2i+1 and 2i+2, so the tree needs no pointer at all.
+ * The positions are also kept as separate arrays of x, y and z, so
+ * that the distances to a whole bucket are computed at once (Float8).
  */
 class PhotonMap
 {
-    typedef std::array<double, 3> ArrayPoint ; ///< Three component vector
-    typedef ssrc::spatial::kd_tree< ArrayPoint, boost::shared_ptr<Photon> > Tree; ///< The new tree of photons
-
 public:
     /**
-	 * \brief Constructor optimizing the kd-tree
-	 * \param list : the list of all absorbed photons during the photon-mapping
+	 * \brief Constructor balancing the kd-tree
+	 * \param list : the list of all absorbed photons during the photon-mapping,
+	 * emptied since the map takes over its content
      *
      * Tidy the given photon-list efficiently for all the futur searches for the k-nearest.
 	 */
-    PhotonMap(std::vector< boost::shared_ptr<Photon> > list)
-    {
-        for(std::vector< boost::shared_ptr<Photon> >::iterator it = list.begin() ; it != list.end() ; it++)
-        {
-            const Point3D& point3d = (*it)->get_end_point() ;
-            ArrayPoint array_point ;
+    PhotonMap(std::vector<StoredPhoton>& list) ;
 
-            array_point[0] = point3d[0] ;
-            array_point[1] = point3d[1] ;
-            array_point[2] = point3d[2] ;
+    static const unsigned int BUCKET_SIZE = 8 ; ///< Maximum number of photons of a leaf, one Float8
 
-            _map[array_point] = (*it) ;
-        }
+    const std::vector<StoredPhoton>& get_photons() const { return _photons ; } ///< Returns all the photons of the map, in bucket order
+    const StoredPhoton& get_photon(unsigned int index) const { return _photons[index] ; } ///< Returns the photon at the given index
 
-        std::cout << "Balancing the photon KD-Tree..." << std::endl ;
-        _map.optimize() ;
-        std::cout << "Optimization done." << std::endl ;
+    /**
+	 * \brief Finds the photons nearest to the center of a search
+	 * \param np : search previously prepared with NearestPhotons::reset(),
+	 * filled with the photons found
+     *
+     * Does not allocate anything, the storage of np is reused
+	 */
+    void get_k_nearest(NearestPhotons& np) const
+    {
+        if (!_photons.empty())
+            locate_photons(np, 0, 0, _photons.size()) ;
     }
 
     /**
-	 * \brief Returns a list of the given point's k-nearest-photons
-	 * \param point : the center of the searching sphere
-     * \param k : the number of photons to find near the point
+	 * \brief Calls visitor(photon) for every photon within a radius of a point
+	 * \param point : the center of the search
+	 * \param radius2 : the squared radius of the search, photons at this distance included
+	 * \param visitor : functor taking a const StoredPhoton&
+     *
+     * Unlike get_k_nearest(), the number of photons found has no limit
 	 */
-    std::vector< boost::shared_ptr<Photon> > get_k_nearest(const Point3D& point, int k )
+    template<typename Visitor>
+    void visit_in_radius(const Point3D& point, double radius2, Visitor& visitor) const
     {
-        std::vector< boost::shared_ptr<Photon> > ret ;
-        ret.clear() ;
-
-        if( k <= 0 )
-        {
-            for(Tree::iterator it = _map.begin() ; it != _map.end() ; it++)
-                ret.push_back(it->second) ;
-
-            return ret ;
-        }
-
-        Tree::knn_iterator iter_debut, iter_fin ;
+        if (!_photons.empty())
+            visit_subtree(point, radius2, visitor, 0, 0, _photons.size()) ;
+    }
 
-        ArrayPoint array_point ;
+    Color estimate_flux(const Point3D& point, int nb_to_find, int nb_emitted, double max_distance, NearestPhotons& np) const ; ///< Density estimation of the flux reaching a point from its nearest photons
+    Color get_nearest_power(const Point3D& point, double max_distance, NearestPhotons& np) const ; ///< Returns the power of the photon nearest to a point, black if there is none within max_distance
 
-        array_point[0] = point[0] ;
-        array_point[1] = point[1] ;
-        array_point[2] = point[2] ;
+    bool save(std::ostream& stream, uint64_t key) const ; ///< Writes the balanced photons into a file, tagged with the given key
+    static PhotonMap * load(std::istream& stream, uint64_t key) ; ///< Reads a map written by save() with the same key, NULL if there is none
 
-        std::pair<Tree::knn_iterator,Tree::knn_iterator> iters =
-            _map.find_nearest_neighbors(array_point, 1000) ;
+private:
+    PhotonMap() {} ///< Empty map, filled by load()
 
-        for(Tree::knn_iterator it = iters.first ; it != iters.second ; it++)
-            ret.push_back( it->second ) ;
+    static void sort_buckets(std::vector<StoredPhoton>& list, unsigned int begin, unsigned int end) ; ///< Splits list[begin, end) at its middle along its widest axis and recurses on both halves
+    void build_nodes(unsigned int node, unsigned int begin, unsigned int end) ; ///< Finds the splitting plane of the node covering the sorted photons [begin, end) and of its descendants
+    void index_photons() ; ///< Builds the nodes and the position arrays from the sorted photons
+    void locate_photons(NearestPhotons& np, unsigned int node, unsigned int begin, unsigned int end) const ; ///< Recursive search of the subtree rooted at node
 
-        return ret ;
+    /**
+	 * \brief Squared distances from a point to the photons of a bucket, computed at once
+	 * \param point : the center of the search
+	 * \param radius2 : the squared radius of the search
+	 * \param inclusive : whether the photons at exactly this radius are kept
+	 * \param begin, end : the photons of the bucket
+	 * \param dist2 : filled with the squared distance of each photon of the bucket
+	 *
+	 * Returns the photons of the bucket within the radius, photon begin + i as bit i
+	 */
+    int search_bucket(const Point3D& point, double radius2, bool inclusive, unsigned int begin, unsigned int end,
+            float dist2[BUCKET_SIZE]) const
+    {
+        Float8 dx = Float8::load(&_x[begin]) - Float8((float)point[0]) ;
+        Float8 dy = Float8::load(&_y[begin]) - Float8((float)point[1]) ;
+        Float8 dz = Float8::load(&_z[begin]) - Float8((float)point[2]) ;
+        Float8 d2 = dx * dx + dy * dy + dz * dz ;
+        d2.store(dist2) ;
+
+        Float8 r2((float)std::min(radius2, (double)std::numeric_limits<float>::max())) ;
+        int within = inclusive ? (d2 <= r2).mask() : (d2 < r2).mask() ;
+        return within & ((1 << (end - begin)) - 1) ;
     }
 
-
-    void optimize()
+    /**
+	 * \brief Recursive search of visit_in_radius() in the subtree rooted at node
+	 */
+    template<typename Visitor>
+    void visit_subtree(const Point3D& point, double radius2, Visitor& visitor,
+            unsigned int node, unsigned int begin, unsigned int end) const
     {
-        _map.optimize() ;
-    } ///< More simple method to optimize
+        if (end - begin <= BUCKET_SIZE) {
+            float dist2[BUCKET_SIZE] ;
+            int within = search_bucket(point, radius2, true, begin, end, dist2) ;
+            for (unsigned int i = 0; within != 0; i++, within >>= 1)
+                if (within & 1)
+                    visitor(_photons[begin + i]) ;
+            return ;
+        }
 
-private:
-    Tree _map ; ///< The optimized tree of photons
+        unsigned int middle = begin + (end - begin) / 2 ;
+        double delta = point[_axis[node]] - _split[node] ;
+        if (delta <= 0 || delta * delta <= radius2)
+            visit_subtree(point, radius2, visitor, 2 * node + 1, begin, middle) ;
+        if (delta >= 0 || delta * delta <= radius2)
+            visit_subtree(point, radius2, visitor, 2 * node + 2, middle, end) ;
+    }
+
+    std::vector<StoredPhoton> _photons ; ///< All the photons, sorted in buckets
+    std::vector<float> _split ; ///< Coordinate of the splitting plane of each inner node
+    std::vector<unsigned char> _axis ; ///< Splitting axis of each inner node
+    std::vector<float> _x, _y, _z ; ///< Positions of the photons, padded so that the last bucket can be read whole
 } ;
 
 #endif // PHOTON_MAP_HPP_
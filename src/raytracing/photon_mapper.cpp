@@ -4,149 +4,474 @@
  * \author B.BORGOBELLO
  */
 
+#include <algorithm>
+#include <fstream>
 #include "photon_mapper.hpp"
 #include "global_parameters.hpp"
+#include "parallel.hpp"
+#include "hash.hpp"
 #include <lights/radiant_object.hpp>
 #include <lights/radiant_volume.hpp>
 
 using std::vector ;
 using boost::shared_ptr ;
+
+/**
+ * \param sc : the scene to photon-trace
+ * \param nb_photons : the number of photons emitted for the global photon-map
+ * \param nb_caustic_photons : the number of photons emitted for the caustic photon-map, 0 for none
+ * \param photon_depth : the maximum number of reflection/refraction of a photon
+ * \param irradiance_step : one photon out of irradiance_step of the global map gets a precomputed irradiance, 0 for none
+ * \param load_filename : photon map file to reuse, empty for none
+ *
+ * Without caustic map, every photon goes into the global map. Otherwise the
+ * global map only keeps the photons absorbed where they were emitted to, the
+ * caustic photons being estimated from their own, denser, map : both passes
+ * together count each light path once.
+ */
+PhotonMapper::PhotonMapper(const Scene& sc, int nb_photons, int nb_caustic_photons, int photon_depth, int irradiance_step,
+        const std::string& load_filename) :
+    _key(get_key(sc, nb_photons, nb_caustic_photons, photon_depth))
+{
+    using namespace std;
+    PhotonMap *map = NULL;
+    PhotonMap *caustic_map = NULL;
+
+    if (!load_filename.empty()) {
+        std::ifstream stream(load_filename.c_str(), std::ios::in | std::ios::binary);
+        if (!stream)
+            cout << "Can't read the photon map file " << load_filename << endl;
+        else {
+            map = PhotonMap::load(stream, _key);
+            if (map != NULL && nb_caustic_photons > 0) {
+                caustic_map = PhotonMap::load(stream, _key);
+                if (caustic_map == NULL) {
+                    delete map;
+                    map = NULL;
+                }
+            }
+        }
+
+        if (map != NULL) {
+            cout << "Photon map read from " << load_filename << " (" << map->get_photons().size() << " photons";
+            if (caustic_map != NULL)
+                cout << ", " << caustic_map->get_photons().size() << " caustic photons";
+            cout << ")" << endl << endl;
+        }
+        else
+            cout << "Building the photon map again" << endl << endl;
+    }
+    if (map == NULL) {
+        if (nb_caustic_photons > 0) {
+            map = build_photon_tree(sc, nb_photons, photon_depth, GLOBAL_PHOTONS, 0);
+            // The caustic photons take the streams following the global ones
+            caustic_map = build_photon_tree(sc, nb_caustic_photons, photon_depth, CAUSTIC_PHOTONS, nb_photons);
+        }
+        else
+            map = build_photon_tree(sc, nb_photons, photon_depth, ALL_PHOTONS, 0);
+    }
+
+    _photon_map = boost::shared_ptr<PhotonMap>(map);
+    _caustic_map = boost::shared_ptr<PhotonMap>(caustic_map);
+
+    // Not saved with the maps : it also depends on the photons to find, and takes little time
+    if (irradiance_step > 0)
+        _irradiance_map = boost::shared_ptr<PhotonMap>(precompute_irradiance(*map, irradiance_step, nb_photons));
+}
+
+/**
+ * \param filename : the file to write, overwritten
+ *
+ * The global map is written first, followed by the caustic map if any.
+ * Returns false if the file could not be written
+ */
+bool PhotonMapper::save(const std::string& filename) const
+{
+    std::ofstream stream(filename.c_str(), std::ios::out | std::ios::binary) ;
+    bool saved = stream && _photon_map->save(stream, _key) ;
+    if (saved && has_caustic_map())
+        saved = _caustic_map->save(stream, _key) ;
+
+    if (!saved)
+        std::cout << "Can't write the photon map file " << filename << std::endl ;
+    return saved ;
+}
+
+/**
+ * \brief Hash of everything the photon maps depend on
+ * \param scene : the scene to photon-trace
+ * \param nb_photon_MAX : the number of photons emitted for the global photon-map
+ * \param nb_caustic_photon_MAX : the number of photons emitted for the caustic photon-map
+ * \param photon_depth : the maximum number of reflection/refraction of a photon
+ *
+ * Chains the hash of the shapes, textures and lights of the scene
+ * with the photon parameters, direct lighting included since it
+ * takes the place of the photons coming straight from the lights. The camera and the resolution are
+ * not part of it : moving the camera keeps the photon map valid.
+ */
+uint64_t PhotonMapper::get_key(const Scene& scene, int nb_photon_MAX, int nb_caustic_photon_MAX, int photon_depth)
+{
+    GlobalParameters *params = GlobalParameters::get_unique_instance() ;
+    uint64_t content_hash = scene.get_content_hash() ;
+    unsigned int seed = params->get_seed() ;
+    bool direct_lighting = params->get_direct_lighting() ;
+
+    uint64_t key = fnv1a(&content_hash, sizeof(content_hash)) ;
+    key = fnv1a(&nb_photon_MAX, sizeof(nb_photon_MAX), key) ;
+    key = fnv1a(&nb_caustic_photon_MAX, sizeof(nb_caustic_photon_MAX), key) ;
+    key = fnv1a(&photon_depth, sizeof(photon_depth), key) ;
+    key = fnv1a(&seed, sizeof(seed), key) ;
+    key = fnv1a(&direct_lighting, sizeof(direct_lighting), key) ;
+    return key ;
+}
 
 /**
  * \brief Creates the photon map with the given scene
  * \param scene : the scene to photon-trace
- * \param nb_photon_MAX : the size (in number of photons) of the photon-map
+ * \param nb_photon_MAX : the number of photons to emit
  * \param photon_depth : the maximum number of reflection/refraction of a photon
+ * \param selection : the stored photons to keep in the map
+ * \param first_stream : the Sampler stream of the first photon, the following
+ * photons taking the next ones
+ *
+ * The photons are traced in chunks shared among the threads, each chunk
+ * as one wavefront (trace_wavefront()). Each photon
+ * draws from its own Sampler (keyed by the seed and its index) and the
+ * chunks are merged in order : for a given seed, the photon map does not
+ * depend on the number of threads.
  *
  * Returns the list of absorbed photons
  */
+PhotonMap * PhotonMapper::build_photon_tree(const Scene& scene, int nb_photon_MAX , int photon_depth,
+        PhotonSelection selection, uint64_t first_stream)
+{
+    using namespace std;
+    GlobalParameters *params = GlobalParameters::get_unique_instance() ;
+    std::vector< boost::shared_ptr<Light> > light_list = scene.get_light_list();
+
+    cout << "!!STARTING " << ((selection == CAUSTIC_PHOTONS) ? "CAUSTIC " : "") << "PHOTON-MAPPING WITH LEVEL " << photon_depth << " !!" << endl <<endl;
 
-PhotonMap * PhotonMapper::build_photon_tree(const Scene& scene, int nb_photon_MAX , int photon_depth)
+    std::vector<const RadiantObject*> radiants ;
+    for (unsigned int j = 0; j < light_list.size(); j++)
+    {
+        const RadiantObject *current_radiant = dynamic_cast<RadiantObject*>(light_list[j].get());
+        if (current_radiant == NULL) continue;
+
+        cout << "Random photoning light " << j << endl;
+        if (dynamic_cast<const RadiantVolume*>(current_radiant))
+            cout << "RADIANT VOLUME !" << endl;
+        radiants.push_back(current_radiant) ;
+    }
+
+    // Photon i is emitted by radiants[i / nb_per_light]
+    static const unsigned int CHUNK_SIZE = 1024 ;
+    unsigned int nb_per_light = radiants.empty() ? 0 : nb_photon_MAX / radiants.size() ;
+    unsigned int nb_emitted = nb_per_light * radiants.size() ;
+    unsigned int nb_chunks = (nb_emitted + CHUNK_SIZE - 1) / CHUNK_SIZE ;
+    uint64_t seed = params->get_seed() ;
+    bool store_direct = !params->get_direct_lighting() ;
+
+    std::vector< std::vector<StoredPhoton> > chunks(nb_chunks) ;
+
+    auto trace_chunk = [&](unsigned int chunk, unsigned int)
+    {
+        unsigned int end = std::min((chunk + 1) * CHUNK_SIZE, nb_emitted) ;
+        trace_wavefront(scene, radiants, nb_per_light, chunk * CHUNK_SIZE, end, photon_depth, seed, first_stream,
+                selection, store_direct, chunks[chunk]) ;
+    } ;
+
+    parallel_for(nb_chunks, get_nb_threads(params->get_threads()), trace_chunk) ;
+
+    // Merging in the order of the photons
+    std::vector<StoredPhoton> photons ;
+    unsigned int nb_stored = 0 ;
+    for (unsigned int c = 0; c < nb_chunks; c++)
+        nb_stored += chunks[c].size() ;
+    photons.reserve(nb_stored) ;
+    for (unsigned int c = 0; c < nb_chunks; c++) {
+        photons.insert(photons.end(), chunks[c].begin(), chunks[c].end()) ;
+        std::vector<StoredPhoton>().swap(chunks[c]) ;
+    }
+
+    cout << endl << nb_stored << endl << endl;
+
+	return new PhotonMap(photons) ;
+}
+
+/**
+ * \brief Precomputes the irradiance at a subset of the photons (Christensen)
+ * \param map : the photon map whose flux is estimated
+ * \param step : one photon out of step is kept
+ * \param nb_photon_MAX : the number of photons emitted to build the map
+ *
+ * Each kept photon gets, instead of its own power, the flux estimated at its
+ * position by the whole map with nb_photon_to_find photons. The estimate at a
+ * point is then the power of the nearest of these photons : a single nearest
+ * neighbour search, without any summation. The photons are taken along the
+ * bucket order of the map, which sorts them in space : every region keeps its share.
+ *
+ * Returns the map of the kept photons, flagged StoredPhoton::IRRADIANCE
+ */
+PhotonMap * PhotonMapper::precompute_irradiance(const PhotonMap& map, int step, int nb_photon_MAX)
 {
     using namespace std;
-    // Photon list building code...
-	std::vector< boost::shared_ptr<Photon> > photons ;
+    GlobalParameters *params = GlobalParameters::get_unique_instance() ;
+    const std::vector<StoredPhoton>& photons = map.get_photons() ;
+    int nb_to_find = params->get_nb_photon_to_find() ;
+    double max_distance = params->get_max_search_radius() ;
 
-    std::vector< boost::shared_ptr<Shape> > shape_list = scene.get_shape_list();
-    std::vector< boost::shared_ptr<Light> > light_list = scene.get_light_list();
+    cout << "Precomputing the irradiance at one photon out of " << step << endl ;
 
-    int cpt = 0;
-    bool intersection_found;
-    double current_distance, best_distance;
-    Couple3D current_couple, best_couple;
-    boost::shared_ptr<Shape> current_shape, best_shape;
-    boost::shared_ptr<Light> current_light;
-    RadiantObject * current_radiant;
-    boost::shared_ptr<Photon> photon_temp, photon_radiant;
-    Photon * photon;
-    bool is_a_radiant_volume = false;
+    static const unsigned int CHUNK_SIZE = 1024 ;
+    unsigned int nb_kept = (photons.size() + step - 1) / step ;
+    unsigned int nb_chunks = (nb_kept + CHUNK_SIZE - 1) / CHUNK_SIZE ;
+    unsigned int nb_threads = get_nb_threads(params->get_threads()) ;
 
+    std::vector<StoredPhoton> kept(nb_kept) ;
+    std::vector<NearestPhotons> nearest_photons(nb_threads) ;
 
-    cout << "!!STARTING PHOTON-MAPPING WITH LEVEL " << photon_depth << " !!" << endl <<endl;
+    auto estimate_chunk = [&](unsigned int chunk, unsigned int thread)
+    {
+        unsigned int end = std::min((chunk + 1) * CHUNK_SIZE, nb_kept) ;
+        for (unsigned int i = chunk * CHUNK_SIZE; i < end; i++) {
+            kept[i] = photons[i * step] ;
+            kept[i].set_power(map.estimate_flux(kept[i].get_position(), nb_to_find, nb_photon_MAX, max_distance, nearest_photons[thread])) ;
+            kept[i].flags |= StoredPhoton::IRRADIANCE ;
+        }
+    } ;
 
-    int nb_radiant = 0 ;
-    for (unsigned int j = 0; j < light_list.size(); j++)
-        if( dynamic_cast<RadiantObject*>(light_list[j].get()) != 0 )
-            nb_radiant++ ;
+    parallel_for(nb_chunks, nb_threads, estimate_chunk) ;
 
-    for (unsigned int j = 0; j < light_list.size(); j++)
+    return new PhotonMap(kept) ;
+}
+
+/**
+ * \struct PhotonWavefront
+ * \brief The photons in flight of a batch, one array per component
+ *
+ * Slot k holds the photon index[k] of the batch. The packets of the
+ * wavefront read their lanes straight from these arrays.
+ */
+struct PhotonWavefront
+{
+    std::vector<double> origin[3]; ///< Components of the positions
+    std::vector<double> direction[3]; ///< Components of the unit directions
+    std::vector<double> t_min; ///< Distance up to which the intersections are ignored, not null when leaving a surface
+    std::vector<double> color[3]; ///< Red, green and blue components of the colors
+    std::vector<unsigned int> index; ///< Number of the photon in the batch
+
+    unsigned int size() const { return index.size(); } ///< Returns the number of photons in flight
+
+    /**
+     * \brief Changes the number of photons in flight
+     */
+    void resize(unsigned int nb)
     {
-        is_a_radiant_volume = false;
-        cout << "Random photoning light " << j << endl;
-        current_radiant = dynamic_cast<RadiantObject*>(light_list[j].get());
+        for (int a = 0; a < 3; a++) {
+            origin[a].resize(nb);
+            direction[a].resize(nb);
+            color[a].resize(nb);
+        }
+        t_min.resize(nb);
+        index.resize(nb);
+    }
 
-        //check
-        if (current_radiant == NULL) continue;
-        if (dynamic_cast<RadiantVolume*>(current_radiant)) {
-            is_a_radiant_volume = true;
-            cout << "RADIANT VOLUME !" << endl;
+    /**
+     * \brief Writes a photon in slot k
+     */
+    void set_photon(unsigned int k, const Photon& photon)
+    {
+        Color c = photon.get_color();
+        for (int a = 0; a < 3; a++) {
+            origin[a][k] = photon.get_end_point()[a];
+            direction[a][k] = photon.get_direction()[a];
+        }
+        t_min[k] = photon.get_t_min();
+        color[0][k] = c.get_r();
+        color[1][k] = c.get_g();
+        color[2][k] = c.get_b();
+    }
+
+    /**
+     * \brief Returns the photon of slot k, to be redirected by a shape
+     */
+    Photon get_photon(unsigned int k) const
+    {
+        Vector3D dir(direction[0][k], direction[1][k], direction[2][k]);
+        Photon photon(Point3D(origin[0][k], origin[1][k], origin[2][k]), dir, Color(color[0][k], color[1][k], color[2][k]));
+        photon.set_direction(dir); // as it is, the constructor normalizes it once more
+        photon.set_interval(t_min[k], std::numeric_limits<double>::max());
+        return photon;
+    }
+
+    /**
+     * \brief Copies slot j of another wavefront into slot k
+     */
+    void copy_slot(unsigned int k, const PhotonWavefront& from, unsigned int j)
+    {
+        for (int a = 0; a < 3; a++) {
+            origin[a][k] = from.origin[a][j];
+            direction[a][k] = from.direction[a][j];
+            color[a][k] = from.color[a][j];
+        }
+        t_min[k] = from.t_min[j];
+        index[k] = from.index[j];
+    }
+
+    /**
+     * \brief Returns the octant (0 to 7) of the direction of slot k, bit i set when its i-th component is negative
+     */
+    int get_octant(unsigned int k) const
+    {
+        return (direction[0][k] < 0) | ((direction[1][k] < 0) << 1) | ((direction[2][k] < 0) << 2);
+    }
+
+    /**
+     * \brief Fills this wavefront with the slots of another one which are still alive
+     * \param from : the wavefront to compact
+     * \param alive : whether each slot of from is still in flight
+     *
+     * Sorted by the octant of their direction, the photons of a packet
+     * cross the BVH in the same order. The sort keeps the order of
+     * the photons within an octant.
+     */
+    void compact(const PhotonWavefront& from, const std::vector<unsigned char>& alive)
+    {
+        unsigned int octant_begin[9] = { 0 };
+        for (unsigned int j = 0; j < from.size(); j++)
+            if (alive[j]) octant_begin[from.get_octant(j) + 1]++;
+        for (int o = 0; o < 8; o++)
+            octant_begin[o + 1] += octant_begin[o];
+
+        resize(octant_begin[8]);
+        for (unsigned int j = 0; j < from.size(); j++)
+            if (alive[j]) copy_slot(octant_begin[from.get_octant(j)]++, from, j);
+    }
+};
+
+/**
+ * \brief Emits a batch of photons and follows them together until they are absorbed
+ * \param scene : the scene to photon-trace
+ * \param radiants : the lights emitting photons, photon i being emitted by radiants[i / nb_per_light]
+ * \param nb_per_light : the number of photons emitted by each light
+ * \param begin, end : the photons of the batch
+ * \param photon_depth : the maximum number of reflection/refraction of a photon
+ * \param seed : the seed of the photon samplers
+ * \param first_stream : the Sampler stream of photon 0
+ * \param selection : the stored photons to keep
+ * \param store_direct : whether to keep the photons absorbed where they were emitted to,
+ * false when the direct lighting is traced with shadow rays
+ * \param photons : the list where the stored photons are appended, in the order of the photons
+ *
+ * The photons in flight form a PhotonWavefront : at each bounce the survivors
+ * are compacted at its front, the whole wavefront is intersected with the
+ * scene by packets of four read from its arrays, then redirected. Each
+ * photon draws from its own Sampler, so the stored photons are the same
+ * as if they were traced one by one.
+ *
+ * A photon is caustic when it was reflected or refracted before being
+ * absorbed : in this model every redirection is specular, so it lit
+ * the surface through a mirror or a transparent object.
+ */
+void PhotonMapper::trace_wavefront(const Scene& scene, const std::vector<const RadiantObject*>& radiants,
+        unsigned int nb_per_light, unsigned int begin, unsigned int end, int photon_depth, uint64_t seed,
+        uint64_t first_stream, PhotonSelection selection, bool store_direct, std::vector<StoredPhoton>& photons)
+{
+    unsigned int nb = end - begin;
+    std::vector<Sampler> samplers; // of each photon of the batch
+    std::vector<unsigned char> caustic(nb, 0);
+    std::vector<StoredPhoton> emitted(nb), absorbed(nb);
+    std::vector<unsigned char> stored(nb, 0); // 1 : emitted photon stored, 2 : absorbed photon stored
+    std::vector<unsigned char> alive(nb, 1); // of each slot of the wavefront
+    std::vector<Hit> hits(nb);
+    PhotonWavefront wavefront, compacted;
+
+    samplers.reserve(nb);
+    wavefront.resize(nb);
+    for (unsigned int i = 0; i < nb; i++) {
+        const RadiantObject& radiant = *radiants[(begin + i) / nb_per_light];
+        samplers.push_back(Sampler(seed, first_stream + begin + i));
+        Photon photon = radiant.emit_photon(samplers[i]);
+        wavefront.set_photon(i, photon);
+        wavefront.index[i] = i;
+
+        if (selection != CAUSTIC_PHOTONS && dynamic_cast<const RadiantVolume*>(&radiant)) {
+            emitted[i] = StoredPhoton(photon.get_end_point(), photon.get_direction(), photon.get_color(), StoredPhoton::EMITTED);
+            stored[i] |= 1;
         }
-        // fin test
+    }
 
-        for (int i=0; i<nb_photon_MAX/nb_radiant; i++)
-        {
-            photon_temp = current_radiant->random_photon();
-            photon = photon_temp.get();
+    for (int x = 0; x < photon_depth; x++) {
+        compacted.compact(wavefront, alive);
+        std::swap(wavefront, compacted);
+        unsigned int nb_in_flight = wavefront.size();
+        if (nb_in_flight == 0) break;
+
+        for (unsigned int k = 0; k < nb_in_flight; k += RayPacket::SIZE) {
+            const double* origin[3] = { &wavefront.origin[0][k], &wavefront.origin[1][k], &wavefront.origin[2][k] };
+            const double* direction[3] = { &wavefront.direction[0][k], &wavefront.direction[1][k], &wavefront.direction[2][k] };
+            int nb_lanes = std::min((int)(nb_in_flight - k), (int)RayPacket::SIZE);
+            scene.intersect_packet(RayPacket(origin, direction, &wavefront.t_min[k], nb_lanes), &hits[k]);
+        }
 
-            if (is_a_radiant_volume) {
-                photons.push_back(photon_radiant = boost::shared_ptr<Photon>(new Photon(photon->get_end_point(), photon->get_direction(), photon->get_color())));
+        alive.assign(nb_in_flight, 0);
+        for (unsigned int k = 0; k < nb_in_flight; k++) {
+            unsigned int i = wavefront.index[k];
+            const Hit& hit = hits[k];
+            if (!hit.is_found()) {
+                //cout << "Photon lost into void\n";
+                continue;
             }
-            for (int x = 0; x < photon_depth; x++) {
-                intersection_found = false;
-                best_distance = -1;
-                for (unsigned int k = 0; k < shape_list.size(); k++) { // Find nearest shape
-                    current_shape = shape_list[k];
-                    if (current_shape->is_intersected_by(*photon)) {
-                        current_couple = current_shape->get_nearest_intersection_with_normal(*photon);
-                        current_distance = (photon->get_end_point() - current_couple.first).norm();
-
-                        if (!intersection_found || current_distance < best_distance) {
-                            intersection_found = true;
-                            best_shape = current_shape;
-                            best_couple = current_couple;
-                            best_distance = current_distance;
-                        }
-                    }
-                }
-                if (intersection_found) {
-                    //cout << "Best distance = " << best_distance << endl;
-                    //cout << "Best couple :\n" << best_couple.first << endl << endl << best_couple.second << endl;
-                    if (!best_shape->redirect_photon(best_couple, *photon_temp)) { // absorbed
-                        //cout << "A new absorbed photon !\n"; // save in photon_map
-                        photon_temp->set_end_point(best_couple.first);
-                        Color ph_c = photon_temp->get_color() ;
-
-                        if(
-                            ph_c.get_r() == ph_c.get_g()
-                            && ph_c.get_r() == ph_c.get_b()
-                            && ph_c.get_r() == 0.0
-                        )
-                            continue ;
-
-                        double pow = current_radiant->get_power() ;
-
-                        Color final_ph_c(
-                            ph_c.get_r() * pow,
-                            ph_c.get_g() * pow,
-                            ph_c.get_b() * pow
-                        ) ;
-
-                        boost::shared_ptr<Photon> photon_final(
-                            new Photon(
-                                photon_temp->get_end_point(),
-                                photon_temp->get_direction(),
-                                final_ph_c
-                            )
-                        ) ;
-
-                        photons.push_back(photon_final);
-                        cpt++;
-                        break;
-                    }
-                    else if (x == photon_depth-1) {
-                        //cout << "Maximum recu level reached, photon lost\n";
-                    }
-                }
-                else {
-                    //cout << "Photon lost into void\n";
-                    break;
-                }
+
+            Photon photon = wavefront.get_photon(k);
+            const Couple3D& best_couple = hit.couple;
+            if (hit.shape->redirect_photon(best_couple, photon, samplers[i])) {
+                caustic[i] = true;
+                wavefront.set_photon(k, photon);
+                alive[k] = 1;
+                continue;
             }
+
+            // absorbed
+            if ((selection == CAUSTIC_PHOTONS && !caustic[i]) || (selection == GLOBAL_PHOTONS && caustic[i])
+                    || (!store_direct && !caustic[i]))
+                continue;
+
+            photon.set_end_point(best_couple.first);
+            photon.leave_surface();
+            Color ph_c = photon.get_color() ;
+
+            if(
+                ph_c.get_r() == ph_c.get_g()
+                && ph_c.get_r() == ph_c.get_b()
+                && ph_c.get_r() == 0.0
+            ) {
+                wavefront.set_photon(k, photon);
+                alive[k] = 1;
+                continue ;
+            }
+
+            double pow = radiants[(begin + i) / nb_per_light]->get_power() ;
+
+            Color final_ph_c(
+                ph_c.get_r() * pow,
+                ph_c.get_g() * pow,
+                ph_c.get_b() * pow
+            ) ;
+
+            absorbed[i] = StoredPhoton(
+                    photon.get_end_point(),
+                    photon.get_direction(),
+                    final_ph_c,
+                    caustic[i] ? StoredPhoton::CAUSTIC : 0
+                );
+            stored[i] |= 2;
         }
     }
+    //cout << "Maximum recu level reached, photons lost\n";
 
-    cout << endl << cpt << endl << endl;
-
-	return new PhotonMap(photons) ;
+    for (unsigned int i = 0; i < nb; i++) {
+        if (stored[i] & 1) photons.push_back(emitted[i]);
+        if (stored[i] & 2) photons.push_back(absorbed[i]);
+    }
 }
-
-/**
- * \param k : number of photon to find around the point
- * \param pt : center of the searching sphere
- *
- * Returns a list of the k nearest photons
- */
-std::vector< boost::shared_ptr<Photon> > PhotonMapper::get_k_nearest_photons(int k, const Point3D& pt) const
-{
-	return _photon_map->get_k_nearest(pt, k) ;
-}
@@ -4,12 +4,13 @@
 /**
  * \file photon_mapper.hpp
  * \author B.BORGOBELLO
- * \brief Declaration of class PhotonList
+ * \brief Declaration of class PhotonMapper
  */
 
 #include <string>
 #include <scene.hpp>
 #include "photon_map.hpp"
+#include <lights/radiant_object.hpp>
 #include <boost/shared_ptr.hpp>
 
 /**
@@ -21,22 +22,64 @@ public:
     /**
 	 * \brief Constructor
 	 * \param sc : the scene to photon-trace
-     * \param nb_photons : the size (in number of photons) of the photon-map
+     * \param nb_photons : the number of photons emitted for the global photon-map
+     * \param nb_caustic_photons : the number of photons emitted for the caustic photon-map,
+     * 0 to keep all the photons in the global map
      * \param photon_depth : the maximum number of reflection/refraction of a photon
+     * \param irradiance_step : one photon out of irradiance_step of the global map
+     * gets a precomputed irradiance, 0 for no precomputation
+     * \param load_filename : photon map file to reuse, if any
      *
-     * Directly calls the build_photon_tree method (photon_mapping phase)
+     * Reads the photon maps from load_filename when they were saved for the same
+     * scene and photon parameters, otherwise calls the build_photon_tree method
+     * (photon_mapping phase), then precomputes the irradiance if asked
 	 */
-    PhotonMapper(const Scene& sc, int nb_photons, int photon_depth) :
-    	_photon_map(build_photon_tree(sc, nb_photons, photon_depth)) {}
+    PhotonMapper(const Scene& sc, int nb_photons, int nb_caustic_photons, int photon_depth, int irradiance_step = 0,
+        const std::string& load_filename = "") ;
 
-    std::vector< boost::shared_ptr<Photon> > get_k_nearest_photons(int, const Point3D&) const ; ///< Returns the k nearest photons of the given point
-    void optimize() const { _photon_map->optimize() ; } ///< Optimize the Photon-Map
+    void get_k_nearest_photons(NearestPhotons& np) const { _photon_map->get_k_nearest(np) ; } ///< Fills np with the nearest photons of its center
+    const StoredPhoton& get_photon(unsigned int index) const { return _photon_map->get_photon(index) ; } ///< Returns the photon at the given index
+    const std::vector<StoredPhoton>& get_photons() const { return _photon_map->get_photons() ; } ///< Returns all the photons of the map
+    const PhotonMap& get_global_map() const { return *_photon_map ; } ///< Returns the map of the photons absorbed without any reflection/refraction (all of them without caustic map), but the direct ones with direct lighting
+    bool has_caustic_map() const { return _caustic_map.get() != NULL ; } ///< Returns whether the caustic photons have a map of their own
+    const PhotonMap& get_caustic_map() const { return *_caustic_map ; } ///< Returns the map of the photons reflected/refracted before being absorbed, if any
+    bool has_irradiance_map() const { return _irradiance_map.get() != NULL ; } ///< Returns whether the irradiance was precomputed
+    const PhotonMap& get_irradiance_map() const { return *_irradiance_map ; } ///< Returns the photons carrying the precomputed irradiance, if any
+    bool save(const std::string& filename) const ; ///< Writes the photon maps into a file, to be reused by later runs
+
+    /**
+     * \brief Photon-maps the scene once more, for a pass of the progressive photon mapping
+     * \param sc : the scene to photon-trace
+     * \param nb_photons : the number of photons emitted
+     * \param photon_depth : the maximum number of reflection/refraction of a photon
+     * \param first_stream : the Sampler stream of the first photon, so that each pass emits other photons
+     */
+    static PhotonMap *build_pass(const Scene& sc, int nb_photons, int photon_depth, uint64_t first_stream)
+    { return build_photon_tree(sc, nb_photons, photon_depth, ALL_PHOTONS, first_stream) ; }
 
 private:
+    /**
+     * \brief Photons kept by a photon-mapping pass
+     */
+    enum PhotonSelection
+    {
+        ALL_PHOTONS, ///< Every stored photon (no caustic map)
+        GLOBAL_PHOTONS, ///< Photons absorbed without any reflection/refraction, and emitted photons
+        CAUSTIC_PHOTONS ///< Photons reflected/refracted before being absorbed
+    };
+
+    static uint64_t get_key(const Scene& scene, int nb_photon_MAX, int nb_caustic_photon_MAX, int photon_depth) ; ///< Hash of everything the photon maps depend on
     static PhotonMap *build_photon_tree
-		(const Scene& scene, int nb_photon_MAX , int photon_depth) ; ///< Photon-map the scene and creates the photon_tree
+		(const Scene& scene, int nb_photon_MAX , int photon_depth, PhotonSelection selection, uint64_t first_stream) ; ///< Photon-map the scene and creates the photon_tree
+    static PhotonMap *precompute_irradiance(const PhotonMap& map, int step, int nb_photon_MAX) ; ///< Estimates the flux at a subset of the photons of a map
+    static void trace_wavefront(const Scene& scene, const std::vector<const RadiantObject*>& radiants,
+        unsigned int nb_per_light, unsigned int begin, unsigned int end, int photon_depth, uint64_t seed,
+        uint64_t first_stream, PhotonSelection selection, bool store_direct, std::vector<StoredPhoton>& photons) ; ///< Emits the photons [begin, end) and appends them to photons where they are absorbed
 
     boost::shared_ptr<PhotonMap> _photon_map; ///< List of absorbed photons
+    boost::shared_ptr<PhotonMap> _caustic_map; ///< List of photons absorbed after reflections/refractions only, NULL without caustic map
+    boost::shared_ptr<PhotonMap> _irradiance_map; ///< Subset of the global map carrying the flux estimated at their position, NULL without precomputation
+    uint64_t _key; ///< Hash of the scene and photon parameters the maps were built for
 };
 
 #endif
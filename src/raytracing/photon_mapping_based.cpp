@@ -4,18 +4,171 @@
  * \author T.FEIGLER / B.BORGOBELLO
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <iterator>
+#include <mutex>
 #include "photon_mapping_based.hpp"
-#include "lights/coherent_light_source.hpp"
+#include "lights/radiant_object.hpp"
+#include "lights/radiant_volume.hpp"
 #include "lights/global_lighting.hpp"
 #include "shapes/volume.hpp"
 #include "shapes/surface.hpp"
+#include "parallel.hpp"
 
 using boost::shared_ptr ;
 using std::vector ;
 using std::cout ;
 using std::endl ;
 
+/**
+ * \brief Returns the probability of a shape to refract, 0 for the opaque shapes
+ * \param shape : the shape hit
+ *
+ * The type of the shape tells whether it is a Volume or a Surface,
+ * only the shapes of type OTHER need a dynamic_cast
+ */
+static double get_refraction_prob(const Shape *shape)
+{
+	double refraction_prob = -1.0 ;
+	const Volume *vol ;
+	const Surface *surf ;
+
+	switch (shape->get_type()) {
+	case Shape::SPHERE :
+	case Shape::PARALLELEPIPED :
+		refraction_prob = static_cast< const Volume* >( shape )->get_refraction_prob() ;
+		break ;
+	case Shape::PLANE :
+	case Shape::TRIANGLE :
+		refraction_prob = static_cast< const Surface* >( shape )->get_transparency_prob() ;
+		break ;
+	default :
+		vol = dynamic_cast< const Volume* >( shape ) ;
+		if(vol != 0)
+			refraction_prob = vol->get_refraction_prob() ;
+
+		surf = dynamic_cast< const Surface* >( shape ) ;
+		if(surf != 0)
+			refraction_prob = surf->get_transparency_prob() ;
+	}
+
+	if(refraction_prob <= 0.0)
+		refraction_prob = 0.0 ;
+	return refraction_prob ;
+}
+
+/**
+ * \brief Sums the photons found around a point by PhotonMap::visit_in_radius()
+ */
+struct PhotonGatherer
+{
+	PhotonGatherer() : nb_photons(0) { flux[0] = flux[1] = flux[2] = 0.0 ; }
+
+	void operator()(const StoredPhoton& photon)
+	{
+		Color power = photon.get_power() ;
+		flux[0] += power.get_r() ;
+		flux[1] += power.get_g() ;
+		flux[2] += power.get_b() ;
+		nb_photons++ ;
+	}
+
+	unsigned int nb_photons ; ///< Number of photons found
+	double flux[3] ; ///< Sum of their power
+};
+
+/**
+ * \brief Follows a ray through the reflections and refractions, calling absorb() at each absorbing surface
+ * \param ray : the ray to launch into the scene
+ * \param sc : the scene containing lights/objects/camera
+ * \param depth : the maximum number of reflections/refractions
+ * \param sampler : the random generator of the current pixel
+ * \param stack : storage of the rays waiting to be traced, cleared first
+ * \param absorb : functor called as absorb(hit, normal, weight), the normal on the side of the ray,
+ * weight being the part of the light absorbed there that reaches the pixel
+ * \param first_hit : the nearest intersection of the ray when already known, NULL otherwise
+ *
+ * The rays are traced depth first from an explicit stack, the reflected
+ * ray before the refracted one : the stack never holds more than depth + 1
+ * rays. A ray carries the product of the reflection/refraction
+ * probabilities along its path. After ROULETTE_DEPTH bounces, the rays
+ * weighing less than ROULETTE_WEIGHT are kept with a probability
+ * proportional to their weight, then weigh ROULETTE_WEIGHT : the
+ * estimate stays the same on average, but the number of rays traced
+ * no longer doubles with each level of a deep raytracer_depth.
+ */
+template<typename AbsorbFunctor>
+void PhotonMappingBased::trace_paths(const Ray& ray, const Scene& sc, int depth, Sampler& sampler,
+        PathStack& stack, AbsorbFunctor& absorb, const Hit* first_hit) const
+{
+	static const int ROULETTE_DEPTH = 4 ;
+	static const double ROULETTE_WEIGHT = 0.1 ;
+
+	stack.clear() ;
+	stack.push_back(PathVertex(ray, Color(1.0, 1.0, 1.0), depth)) ;
+
+	while (!stack.empty())
+	{
+		PathVertex vertex = stack.back() ;
+		stack.pop_back() ;
+
+		Hit hit = (first_hit != NULL) ? *first_hit : sc.intersect_nearest(vertex.ray) ;
+		first_hit = NULL ;
+		if (!hit.is_found())
+			continue ;
+
+		const Shape* nearest_shape = hit.shape ;
+		const Couple3D& nearest_couple = hit.couple ;
+
+		// At the last level, the absorbed illumination is taken whole
+		double absorption_prob = (vertex.depth == 0) ? 1.0 : nearest_shape->get_absorption_prob() ;
+		if (absorption_prob > 0.0)
+		{
+			// Normal on the side of the viewer
+			Vector3D normal = nearest_couple.second ;
+			if (normal.dot(vertex.ray.get_direction()) > 0)
+				normal = -normal ;
+
+			absorb(hit, normal, Color(
+					vertex.weight.get_r() * absorption_prob,
+					vertex.weight.get_g() * absorption_prob,
+					vertex.weight.get_b() * absorption_prob
+				)) ;
+		}
+
+		if (vertex.depth == 0)
+			continue ;
+
+		std::pair<Ray, Ray> double_ray = nearest_shape->divide_ray(nearest_couple, vertex.ray) ;
+		const Ray* children[2] = { &double_ray.second, &double_ray.first } ;
+		double probs[2] = { get_refraction_prob(nearest_shape), nearest_shape->get_reflection_prob() } ;
+
+		// Pushed last, the reflected ray is traced first
+		for (int c = 0; c < 2; c++)
+		{
+			if (probs[c] <= 0.0 || children[c]->get_direction().norm() == 0)
+				continue ;
+
+			double scale = probs[c] ;
+			double weight = std::max(vertex.weight.get_r(), std::max(vertex.weight.get_g(), vertex.weight.get_b())) * scale ;
+			if (depth - vertex.depth >= ROULETTE_DEPTH && weight < ROULETTE_WEIGHT)
+			{
+				if (sampler.next_double() * ROULETTE_WEIGHT >= weight)
+					continue ;
+				scale *= ROULETTE_WEIGHT / weight ;
+			}
+
+			stack.push_back(PathVertex(*children[c], Color(
+					vertex.weight.get_r() * scale,
+					vertex.weight.get_g() * scale,
+					vertex.weight.get_b() * scale
+				), vertex.depth - 1)) ;
+		}
+	}
+}
+
 /**
  * \brief Raytraces a scene returning the corresponding image
  * \param sc : the scene to raytrace
@@ -25,7 +178,6 @@ Image PhotonMappingBased::render(const Scene& sc) const
 	GlobalParameters *params = GlobalParameters::get_unique_instance() ;
 	const Camera& cam = *(sc.get_camera()) ;
 	boost::shared_ptr<Light> current_light;
-	int nb_rendered = 0 ;
 	double coef_r = 1.0, coef_g = 1.0, coef_b = 1.0;
 
     std::cout << "!!STARTING RAYTRACING!!" << std::endl;
@@ -59,36 +211,127 @@ Image PhotonMappingBased::render(const Scene& sc) const
 		) ;
     // end
 
-    // Raytracing
-    int nb_total_pixels = img.get_res_x() * img.get_res_y() ;
-
-	for(int j = 0 ; j < img.get_res_y() ; j++)
-	{
-		for(int i = 0 ; i < img.get_res_x() ; i++)
-		{
-		    if( ((nb_rendered * 20) % nb_total_pixels) > (((nb_rendered+1) * 20) % nb_total_pixels) )
-		    {
-                cout << "Raytracing : " << (5 * ((nb_rendered+1) * 20) / nb_total_pixels) << "%" << endl ;
-		    }
-
-            nb_rendered++ ;
-
-			Ray ray = cam.get_ray(
-								i/((double)img.get_res_x()-1),
-								j/((double)img.get_res_y()-1) // BUG ICI
-							) ;
+    // Raytracing, by tiles of TILE_SIZE x TILE_SIZE pixels shared among the threads
+    static const int TILE_SIZE = 16 ;
+    int nb_tiles_x = (img.get_res_x() + TILE_SIZE - 1) / TILE_SIZE ;
+    int nb_tiles_y = (img.get_res_y() + TILE_SIZE - 1) / TILE_SIZE ;
+    unsigned int nb_tiles = nb_tiles_x * nb_tiles_y ;
+    unsigned int nb_threads = get_nb_threads(params->get_threads()) ;
+    int depth = params->get_raytracer_depth() ;
+
+    cout << "Raytracing with " << nb_threads << " thread(s)" << endl ;
+
+    // Each thread reuses its own search storage
+    vector<NearestPhotons> nearest_photons(nb_threads) ;
+    vector<PathStack> path_stacks(nb_threads) ;
+    for (unsigned int t = 0; t < nb_threads; t++)
+        path_stacks[t].reserve(depth + 1) ;
+    // Each pixel draws its shadow rays from its own Sampler, on other sequences than the photons
+    uint64_t pixel_seed = ~(uint64_t)params->get_seed() ;
+    std::atomic<unsigned int> nb_rendered(0) ;
+    std::mutex cout_mutex ;
+
+    // Final gathering : its irradiance cache is filled by passes over coarse
+    // grids of pixels, only read during each pass so that the threads share it
+    bool final_gather = params->get_final_gather_rays() > 0 ;
+    bool use_cache = final_gather && params->get_irradiance_cache_accuracy() > 0.0 ;
+    IrradianceCache cache(params->get_irradiance_cache_accuracy()) ;
+    vector< vector<IrradianceRecord> > tile_records(nb_tiles) ;
+    int stride = 1 ; // Only one pixel out of stride x stride is rendered, the image being written when 1
+
+    auto render_tile = [&](unsigned int tile, unsigned int thread)
+    {
+        int i_min = (tile % nb_tiles_x) * TILE_SIZE ;
+        int j_min = (tile / nb_tiles_x) * TILE_SIZE ;
+        int i_max = std::min(i_min + TILE_SIZE, img.get_res_x()) ;
+        int j_max = std::min(j_min + TILE_SIZE, img.get_res_y()) ;
+
+        GatherContext gather ;
+        gather.cache = use_cache ? &cache : NULL ;
+        gather.new_records = (stride > 1) ? &tile_records[tile] : NULL ; // nothing reads the records of the final pass
+
+        vector<Ray> rays ;
+        rays.reserve(RayPacket::SIZE) ;
+        const Launchable* launchables[RayPacket::SIZE] ;
+        Hit hits[RayPacket::SIZE] ;
+        int i_first = i_min + (stride - i_min % stride) % stride ;
+
+        for(int j = j_min ; j < j_max ; j++)
+        {
+            if (j % stride != 0)
+                continue ;
+
+            // The camera rays of neighbouring pixels of the row find their first hit together
+            for(int i_packet = i_first ; i_packet < i_max ; i_packet += RayPacket::SIZE * stride)
+            {
+                int nb = (i_max - i_packet + stride - 1) / stride ;
+                if (nb > RayPacket::SIZE)
+                    nb = RayPacket::SIZE ;
+
+                rays.clear() ;
+                for (int q = 0 ; q < nb ; q++)
+                    rays.push_back(cam.get_ray(
+                                    (i_packet + q * stride)/((double)img.get_res_x()-1),
+                                    j/((double)img.get_res_y()-1) // BUG ICI
+                                )) ;
+                for (int q = 0 ; q < nb ; q++)
+                    launchables[q] = &rays[q] ;
+                sc.intersect_packet(RayPacket(launchables, nb), hits) ;
+
+                for(int q = 0 ; q < nb ; q++)
+                {
+                    int i = i_packet + q * stride ;
+                    Sampler sampler(pixel_seed, (uint64_t)j * img.get_res_x() + i) ;
+                    Color col_ = get_local_color(rays[q], sc, depth, nearest_photons[thread], sampler,
+                            final_gather ? &gather : NULL, path_stacks[thread], &hits[q]) ;
+                    if (stride > 1)
+                        continue ;
+
+                    // Every pixel belongs to one tile only : no lock needed
+                    img.set_color(
+                            Color(
+                                col_.get_r()*coef_r,
+                                col_.get_g()*coef_g,
+                                col_.get_b()*coef_b
+                            ), i, j) ;
+                }
+            }
+        }
+        if (stride > 1)
+            return ;
 
-			Color col_ = get_local_color(ray, sc, params->get_raytracer_depth()) ;
+        unsigned int done = ++nb_rendered ;
+        if ((done * 20) / nb_tiles != ((done - 1) * 20) / nb_tiles)
+        {
+            std::lock_guard<std::mutex> lock(cout_mutex) ;
+            cout << "Raytracing : " << (5 * ((done * 20) / nb_tiles)) << "%" << endl ;
+        }
+    } ;
 
-			boost::shared_ptr<Color> col(new Color(
-					col_.get_r()*coef_r,
-					col_.get_g()*coef_g,
-					col_.get_b()*coef_b
-				)) ;
+    if (params->get_progressive_passes() > 0)
+        render_progressive(sc, Color(coef_r, coef_g, coef_b), img) ;
+    else
+    {
+        if (use_cache)
+        {
+            for (stride = 16; stride > 1; stride /= 2)
+            {
+                parallel_for(nb_tiles, nb_threads, render_tile) ;
+
+                // Added in the order of the tiles : the cache does not depend on the number of threads
+                vector<IrradianceRecord> records ;
+                for (unsigned int t = 0; t < nb_tiles; t++) {
+                    records.insert(records.end(), tile_records[t].begin(), tile_records[t].end()) ;
+                    tile_records[t].clear() ;
+                }
+                cache.add(records) ;
+                cout << "Irradiance cache : " << cache.get_nb_records() << " records" << endl ;
+            }
+            stride = 1 ;
+        }
 
-			img.add_color(col, i, j) ;
-		}
-	}
+        parallel_for(nb_tiles, nb_threads, render_tile) ;
+    }
 
 	// Reducing image for antialiasing
     if (antialias_coef > 1) {
@@ -103,13 +346,10 @@ Image PhotonMappingBased::render(const Scene& sc) const
 
 		for (int j = 0; j < true_img.get_res_y() ; j++) {
             for (int i = 0; i < true_img.get_res_x() ; i++) {
-                Color color = *img.get_color(i*antialias_coef, j*antialias_coef);
-                color = color + *img.get_color(i*antialias_coef+1, j*antialias_coef);
-                color = color + *img.get_color(i*antialias_coef, j*antialias_coef+1);
-                color = color + *img.get_color(i*antialias_coef+1, j*antialias_coef+1);
-                color = color * (1.0/4.0);
-                boost::shared_ptr<Color> col(new Color(color.get_r(), color.get_g(), color.get_b()));
-                true_img.add_color(col, i, j);
+                true_img.add_color(img.get_color(i*antialias_coef, j*antialias_coef) * (1.0/4.0), i, j);
+                true_img.add_color(img.get_color(i*antialias_coef+1, j*antialias_coef) * (1.0/4.0), i, j);
+                true_img.add_color(img.get_color(i*antialias_coef, j*antialias_coef+1) * (1.0/4.0), i, j);
+                true_img.add_color(img.get_color(i*antialias_coef+1, j*antialias_coef+1) * (1.0/4.0), i, j);
             }
 		}
 		return true_img;
@@ -121,6 +361,121 @@ Image PhotonMappingBased::render(const Scene& sc) const
 }
 
 
+/**
+ * \brief Progressive photon mapping (Hachisuka) : renders an image by passes of photons
+ * \param sc : the scene to raytrace
+ * \param coef : the GlobalLighting coefficients
+ * \param img : the black image to fill, at the rendering resolution
+ *
+ * The points of the absorbing surfaces seen from the pixels are found
+ * once, with their direct lighting. Each pass then emits nb_photon_MAX
+ * new photons, gathered by every point within its radius, and frees them :
+ * the memory does not depend on the number of passes. The first photons
+ * found around a point set its radius to enclose nb_photon_to_find of them,
+ * the radius then shrinking at each pass so that only ALPHA of the new photons
+ * count : the estimate converges as the passes go.
+ */
+void PhotonMappingBased::render_progressive(const Scene& sc, const Color& coef, Image& img) const
+{
+	static const double ALPHA = 0.7 ; // Part of the photons of a pass kept in the statistics
+	static const unsigned int CHUNK_SIZE = 1024 ;
+	GlobalParameters *params = GlobalParameters::get_unique_instance() ;
+	const Camera& cam = *(sc.get_camera()) ;
+	int nb_passes = params->get_progressive_passes() ;
+	int nb_photons = params->get_nb_photon_MAX() ;
+	int nb_to_find = params->get_nb_photon_to_find() ;
+	double max_search_radius = params->get_max_search_radius() ;
+	int depth = params->get_raytracer_depth() ;
+	int res_x = img.get_res_x() ;
+	int res_y = img.get_res_y() ;
+	unsigned int nb_threads = get_nb_threads(params->get_threads()) ;
+	uint64_t pixel_seed = ~(uint64_t)params->get_seed() ;
+
+	// The hit points, found row by row and merged in the order of the rows
+	vector< vector<HitPoint> > rows(res_y) ;
+	vector<PathStack> path_stacks(nb_threads) ;
+	for (unsigned int t = 0; t < nb_threads; t++)
+		path_stacks[t].reserve(depth + 1) ;
+	auto trace_row = [&](unsigned int j, unsigned int thread)
+	{
+		for (int i = 0; i < res_x; i++) {
+			Ray ray = cam.get_ray(
+								i/((double)res_x-1),
+								j/((double)res_y-1)
+							) ;
+			Sampler sampler(pixel_seed, (uint64_t)j * res_x + i) ;
+			collect_hit_points(ray, sc, depth, j * res_x + i, sampler, path_stacks[thread], rows[j]) ;
+		}
+	} ;
+	parallel_for(res_y, nb_threads, trace_row) ;
+
+	vector<HitPoint> hit_points ;
+	for (int j = 0; j < res_y; j++) {
+		hit_points.insert(hit_points.end(), rows[j].begin(), rows[j].end()) ;
+		vector<HitPoint>().swap(rows[j]) ;
+	}
+	cout << hit_points.size() << " hit points" << endl ;
+
+	// The passes, each hit point being updated by one task only
+	vector<NearestPhotons> nearest_photons(nb_threads) ;
+	unsigned int nb_chunks = (hit_points.size() + CHUNK_SIZE - 1) / CHUNK_SIZE ;
+	shared_ptr<PhotonMap> map ;
+
+	auto gather_chunk = [&](unsigned int chunk, unsigned int thread)
+	{
+		unsigned int end = std::min((unsigned int)hit_points.size(), (chunk + 1) * CHUNK_SIZE) ;
+		for (unsigned int h = chunk * CHUNK_SIZE; h < end; h++)
+		{
+			HitPoint& hit_point = hit_points[h] ;
+			if (hit_point.radius2 <= 0.0)
+			{
+				NearestPhotons& np = nearest_photons[thread] ;
+				np.reset(hit_point.position, nb_to_find, max_search_radius) ;
+				map->get_k_nearest(np) ;
+				hit_point.radius2 = np.get_max_squared_distance() ;
+				if (hit_point.radius2 <= 0.0)
+					continue ;
+			}
+
+			PhotonGatherer gatherer ;
+			map->visit_in_radius(hit_point.position, hit_point.radius2, gatherer) ;
+			if (gatherer.nb_photons == 0)
+				continue ;
+
+			double nb_kept = hit_point.nb_photons + ALPHA * gatherer.nb_photons ;
+			double reduction = nb_kept / (hit_point.nb_photons + gatherer.nb_photons) ;
+			hit_point.radius2 *= reduction ;
+			hit_point.nb_photons = nb_kept ;
+			for (int c = 0; c < 3; c++)
+				hit_point.flux[c] = (hit_point.flux[c] + gatherer.flux[c]) * reduction ;
+		}
+	} ;
+
+	for (int pass = 0; pass < nb_passes; pass++)
+	{
+		cout << "Progressive pass " << (pass + 1) << "/" << nb_passes << endl ;
+		// Each pass emits the photons of the following Sampler streams
+		map = shared_ptr<PhotonMap>(PhotonMapper::build_pass(sc, nb_photons, params->get_photon_depth(), (uint64_t)pass * nb_photons)) ;
+		parallel_for(nb_chunks, nb_threads, gather_chunk) ;
+		map.reset() ;
+	}
+
+	// Each photon carried 1/(nb_passes * nb_photons) of the power of its light
+	double inner_photon_power = 1.0 / ((double)nb_passes * nb_photons) ;
+	for (unsigned int h = 0; h < hit_points.size(); h++)
+	{
+		const HitPoint& hit_point = hit_points[h] ;
+		double flux_coef = (hit_point.radius2 > 0.0) ? inner_photon_power / hit_point.radius2 : 0.0 ;
+
+		img.add_color(
+				Color(
+					(hit_point.direct.get_r() + hit_point.flux[0] * flux_coef) * hit_point.weight.get_r() * coef.get_r(),
+					(hit_point.direct.get_g() + hit_point.flux[1] * flux_coef) * hit_point.weight.get_g() * coef.get_g(),
+					(hit_point.direct.get_b() + hit_point.flux[2] * flux_coef) * hit_point.weight.get_b() * coef.get_b()
+				), hit_point.pixel % res_x, hit_point.pixel / res_x) ;
+	}
+}
+
 /**
  * \brief Renders the photon-map (counter raytracing) and returns an Image
  * \param sc : the scene containing the camera
@@ -128,37 +483,35 @@ Image PhotonMappingBased::render(const Scene& sc) const
 Image PhotonMappingBased::render_photonmap(const Scene& sc) const
 {
     GlobalParameters *params = GlobalParameters::get_unique_instance() ;
-	boost::shared_ptr<Color> col;
 
     const Camera& cam = *(sc.get_camera()) ;
-    vector< shared_ptr<Photon> > photons = _photon_mapper.get_k_nearest_photons(-1,Point3D(0,0,0)) ;
+    vector<const PhotonMap*> maps(1, &_photon_mapper.get_global_map()) ;
+    if (_photon_mapper.has_caustic_map())
+        maps.push_back(&_photon_mapper.get_caustic_map()) ;
 
     cout << "!!RAYTRACING THE PHOTON_MAP!!" << endl;
+    // Black image
 	Image img(
 			params->get_res_x(),
 			params->get_res_y()
 		) ;
 
-    // Initializing the image to full_black
-	for(int j = 0 ; j < img.get_res_y() ; j++)
-	{
-		for(int i = 0 ; i < img.get_res_x() ; i++)
-		{
-            img.add_color(col = boost::shared_ptr<Color>(new Color(0,0,0)), i, j) ;
-		}
-	}
-
     std::pair<double, double> coordinates;
     /*boost::shared_ptr<Photon> temp;
     photons.push_back(temp = boost::shared_ptr<Photon>(new Photon(Point3D(-2,0,0)+0.5*Point3D(1,1,1) , Vector3D(1,0,0), Color(0,0,0))));
     */
-    for (unsigned k = 0; k < photons.size(); k++) {
-        //cout << photons[k]->get_end_point() << endl;
-        coordinates = cam.can_see(photons[k]->get_end_point());
-        if (coordinates.first >=0) {
-            //cout << " VS [" << (int)(100*cam.get_ray(coordinates.first, coordinates.second).get_direction()[0]) << ", " << (int)(100*cam.get_ray(coordinates.first, coordinates.second).get_direction()[1]) << ", " << (int)(100*cam.get_ray(coordinates.first, coordinates.second).get_direction()[2]) << "]" << endl;
-            //cout << "Adding color !" << endl;
-            img.add_color(col = boost::shared_ptr<Color>(new Color(1,1,1)), coordinates.first*img.get_res_x(), coordinates.second*img.get_res_y()) ;
+    for (unsigned m = 0; m < maps.size(); m++) {
+        const vector<StoredPhoton>& photons = maps[m]->get_photons() ;
+        for (unsigned k = 0; k < photons.size(); k++) {
+            //cout << photons[k]->get_end_point() << endl;
+            coordinates = cam.can_see(photons[k].get_position());
+            if (coordinates.first >=0) {
+                //cout << " VS [" << (int)(100*cam.get_ray(coordinates.first, coordinates.second).get_direction()[0]) << ", " << (int)(100*cam.get_ray(coordinates.first, coordinates.second).get_direction()[1]) << ", " << (int)(100*cam.get_ray(coordinates.first, coordinates.second).get_direction()[2]) << "]" << endl;
+                //cout << "Adding color !" << endl;
+                int x = std::min((int)(coordinates.first*img.get_res_x()), img.get_res_x()-1) ;
+                int y = std::min((int)(coordinates.second*img.get_res_y()), img.get_res_y()-1) ;
+                img.set_color(Color(1,1,1), x, y) ;
+            }
         }
     }
     cout << "!!PHOTON RAYTRACING TERMINATED!!" << endl;
@@ -166,170 +519,248 @@ Image PhotonMappingBased::render_photonmap(const Scene& sc) const
 }
 
 /**
- * \brief Aimed recursive, computes the color viewed by the given ray
+ * \brief Computes the color viewed by the given ray
  * \param ray : the ray to launch into the scene
  * \param sc : the scene containing lights/objects/camera
- * \param depth: the remaining depth of the recursion
+ * \param depth: the maximum number of reflections/refractions
+ * \param np : storage reused by all the photon searches
+ * \param sampler : the random generator of the current pixel
+ * \param gather : the irradiance cache of the final gathering, NULL without final gathering
+ * \param stack : storage of the rays waiting to be traced, reused by all the pixels of a thread
+ * \param first_hit : the nearest intersection of the ray when already known, NULL otherwise
  */
-Color PhotonMappingBased::get_local_color(Ray ray, const Scene& sc, int depth) const
+Color PhotonMappingBased::get_local_color(const Ray& ray, const Scene& sc, int depth, NearestPhotons& np, Sampler& sampler,
+        GatherContext *gather, PathStack& stack, const Hit* first_hit) const
 {
-	Couple3D nearest_couple ;
-	double nearest_distance_2 = -1.0;
-	vector< shared_ptr<Shape> >::const_iterator shape_it ;
-	vector< shared_ptr<Shape> >::const_iterator final_it ;
-
-	final_it = sc.get_shape_list().end() ;
-
-	for(shape_it = sc.get_shape_list().begin() ; shape_it != sc.get_shape_list().end() ; shape_it++)
-	{
-		if((*shape_it)->is_intersected_by(ray))
-		{
-			Couple3D couple =
-					(*shape_it)->get_nearest_intersection_with_normal(ray) ;
-
-			double this_distance_2 = (ray.get_end_point() - couple.first).squaredNorm() ;
-
-			if(nearest_distance_2 < 0.0
-				|| nearest_distance_2 > this_distance_2)
-			{
-				nearest_couple = couple ;
-				nearest_distance_2 = this_distance_2 ;
-				final_it = shape_it ;
-			}
-		}
-	}
+	GlobalParameters *params = GlobalParameters::get_unique_instance() ;
+	double r, g, b ;
+	r = g = b = 0.0 ;
 
-	if(final_it != sc.get_shape_list().end())
+	auto absorb = [&](const Hit& hit, const Vector3D& normal, const Color& weight)
 	{
-		// An intersection has been found
-		// Now determining its illumination
-		vector< shared_ptr<Light> >::const_iterator it ;
-		double r, g, b ;
-		r = g = b = 0.0 ;
-
-		Point3D nearest_intersection = nearest_couple.first ;
-
-		// Calculation of the direct illumination
-		// For each source of light...
-		/*
-		for( it = sc.get_light_list().begin() ; it != sc.get_light_list().end() ; it++ )
-		{
-			// ...which is coherent...
+		Color flux = get_flux(hit.couple.first, normal, sc, np, sampler, params->get_shadow_rays()) ;
 
-			CoherentLightSource *source =
-					dynamic_cast<CoherentLightSource*>((*it).get()) ;
+		// Light reflected by the surfaces around, where the surface absorbs
+		if (gather != NULL && hit.shape->get_absorption_prob() > 0.0)
+			flux = flux + gather_flux(hit.couple.first, normal, sc, np, sampler, *gather) ;
 
-			if( source == 0 )
-				continue ;
-			if(source->is_viewable_from(nearest_couple.first, sc.get_shape_list()))
-			{
-				double dist_2 = (source->get_location() - nearest_intersection).squaredNorm() ;
+		Color here = hit.shape->get_color_at(hit.couple.first) ;
+		r += flux.get_r() * here.get_r() * weight.get_r() ;
+		g += flux.get_g() * here.get_g() * weight.get_g() ;
+		b += flux.get_b() * here.get_b() * weight.get_b() ;
+	} ;
 
-				Color here = (*final_it)->get_color_at(nearest_intersection) ;
-				double coef = source->get_power() / dist_2 ;
+	trace_paths(ray, sc, depth, sampler, stack, absorb, first_hit) ;
+	return Color(r, g, b) ;
+}
 
-				r += coef * here.get_r() ;
-				g += coef * here.get_g() ;
-				b += coef * here.get_b() ;
-			}
-		}
-        */
+/**
+ * \brief Finds the points of the absorbing surfaces seen by a ray
+ * \param ray : the ray to launch into the scene
+ * \param sc : the scene containing lights/objects/camera
+ * \param depth : the maximum number of reflections/refractions
+ * \param pixel : the index of the pixel
+ * \param sampler : the random generator of the pixel
+ * \param stack : storage of the rays waiting to be traced
+ * \param hit_points : where the points found are appended
+ *
+ * Each hit point gets the weight get_local_color() gives to the light absorbed there
+ */
+void PhotonMappingBased::collect_hit_points(const Ray& ray, const Scene& sc, int depth, unsigned int pixel,
+        Sampler& sampler, PathStack& stack, vector<HitPoint>& hit_points) const
+{
+	GlobalParameters *params = GlobalParameters::get_unique_instance() ;
 
+	auto absorb = [&](const Hit& hit, const Vector3D& normal, const Color& weight)
+	{
+		Color here = hit.shape->get_color_at(hit.couple.first) ;
+		Color direct = params->get_direct_lighting() ?
+			get_direct_flux(hit.couple.first, normal, sc, sampler, params->get_shadow_rays()) : Color(0.0, 0.0, 0.0) ;
+
+		hit_points.push_back(
+				HitPoint(
+					hit.couple.first,
+					normal,
+					Color(
+						weight.get_r() * here.get_r(),
+						weight.get_g() * here.get_g(),
+						weight.get_b() * here.get_b()
+					),
+					direct,
+					pixel
+				)
+			) ;
+	} ;
 
-		// Now, calculation of the indirect illumination
+	trace_paths(ray, sc, depth, sampler, stack, absorb) ;
+}
 
+/**
+ * \brief Light absorbed at a point, in the unit of the photon estimate
+ * \param point : the point of a surface
+ * \param normal : the normal at this point, on the side of the viewer
+ * \param sc : the scene containing lights/objects
+ * \param np : storage reused by all the photon searches
+ * \param sampler : the random generator of the current pixel
+ * \param nb_shadow_rays : the number of shadow rays towards each radiant volume
+ *
+ * Sums the direct lighting, if traced with shadow rays, and the photon
+ * estimates. The color of the surface is not applied.
+ */
+Color PhotonMappingBased::get_flux(const Point3D& point, const Vector3D& normal, const Scene& sc,
+        NearestPhotons& np, Sampler& sampler, unsigned int nb_shadow_rays) const
+{
+	GlobalParameters *params = GlobalParameters::get_unique_instance() ;
 
-		vector< shared_ptr<Photon> > photons ;
-		GlobalParameters *params = GlobalParameters::get_unique_instance() ;
-		photons = _photon_mapper.get_k_nearest_photons(
+	// Calculation of the indirect illumination, looked up when it was precomputed
+	Color flux = _photon_mapper.has_irradiance_map() ?
+		_photon_mapper.get_irradiance_map().get_nearest_power(point, params->get_max_search_radius(), np) :
+		_photon_mapper.get_global_map().estimate_flux(
+				point,
 				params->get_nb_photon_to_find(),
-				nearest_intersection
+				params->get_nb_photon_MAX(),
+				params->get_max_search_radius(),
+				np
 			) ;
 
-		double r_, g_, b_ ;
-		r_ = g_ = b_ = 0.0 ;
-		for(vector< shared_ptr<Photon> >::iterator it = photons.begin() ; it != photons.end() ; it++)
-		{
-			// TODO : verify the coherence of the flux calculated
-			Color ph_color = (*it)->get_color() ;
-			r_ += (*it)->get_color().get_r() ;
-			g_ += (*it)->get_color().get_g() ;
-			b_ += (*it)->get_color().get_b() ;
-		}
-
-        double inner_photon_power =
-            1.0 / params->get_nb_photon_MAX() ;
-
-        double furthest_distance_2 = (nearest_intersection - photons[photons.size()-1]->get_end_point()).squaredNorm() ;
-		double flux_coef = inner_photon_power / furthest_distance_2 ;
-		//cout << "couleur : " << r_ << " " << g_ << " " << b_ << endl ;
-		//cout << "flux coeff : " << flux_coef << endl ;
-		Color c = (*final_it)->get_color_at(nearest_intersection) ;
-		r += r_ * flux_coef * c.get_r() ;
-		g += g_ * flux_coef * c.get_g() ;
-		b += b_ * flux_coef * c.get_b() ;
+	// The caustics, sharper, come from a denser map searched with fewer photons
+	if (_photon_mapper.has_caustic_map())
+		flux = flux + _photon_mapper.get_caustic_map().estimate_flux(
+				point,
+				params->get_nb_caustic_photon_to_find(),
+				params->get_nb_caustic_photon_MAX(),
+				params->get_max_search_radius(),
+				np
+			) ;
 
-		// Now we evaluate recursively the global illumination
-		// TODO : verify the recursively-built rays are correct
+	// Calculation of the direct illumination, with shadow rays
+	if (params->get_direct_lighting())
+		flux = flux + get_direct_flux(point, normal, sc, sampler, nb_shadow_rays) ;
 
-		Color reflected_illumination( 0.0, 0.0, 0.0) ;
-		Color refracted_illumination(0.0, 0.0, 0.0) ;
+	return flux ;
+}
 
-        std::pair<Ray, Ray> double_ray = (*final_it)->divide_ray(nearest_couple, ray);
-        Ray reflected_ray = double_ray.first;
-        Ray refracted_ray = double_ray.second;
+/**
+ * \brief Direct lighting at a point, in the unit of the photon estimate
+ * \param point : the point of a surface
+ * \param normal : the normal at this point, on the side of the viewer
+ * \param sc : the scene containing lights/objects
+ * \param sampler : the random generator of the current pixel
+ * \param nb_shadow_rays : the number of shadow rays towards each radiant volume
+ */
+Color PhotonMappingBased::get_direct_flux(const Point3D& point, const Vector3D& normal, const Scene& sc,
+        Sampler& sampler, unsigned int nb_shadow_rays) const
+{
+	Color direct(0.0, 0.0, 0.0) ;
+	int nb_radiants = 0 ;
 
-        if (depth > 0)
-        {
-            if (reflected_ray.get_direction().norm() != 0)
-                reflected_illumination = get_local_color(reflected_ray, sc, depth - 1);
+	// For each source of light...
+	vector< shared_ptr<Light> >::const_iterator it ;
+	for( it = sc.get_light_list().begin() ; it != sc.get_light_list().end() ; it++ )
+	{
+		// ...which emits photons...
+		const RadiantObject *source =
+				dynamic_cast<const RadiantObject*>((*it).get()) ;
+
+		if( source == 0 )
+			continue ;
+		nb_radiants++ ;
+		direct = direct + source->get_direct_illumination(point, normal, sc, sampler, nb_shadow_rays) ;
+	}
 
-            if (refracted_ray.get_direction().norm() != 0)
-                refracted_illumination = get_local_color(refracted_ray, sc, depth - 1);
-        }
+	// The photons are shared among the sources, so is their power in the photon estimate
+	if (nb_radiants > 0)
+		direct = direct * (1.0 / nb_radiants) ;
+	return direct ;
+}
 
-		Color absorbed_illumination(r, g, b) ;
+/**
+ * \brief Final gathering : light reflected towards a point by the surfaces around it
+ * \param point : the point of a surface
+ * \param normal : the normal at this point, on the side of the viewer
+ * \param sc : the scene containing lights/objects
+ * \param np : storage reused by all the photon searches
+ * \param sampler : the random generator of the current pixel
+ * \param gather : the irradiance cache, and where to add the new records
+ *
+ * Rays are cast over the hemisphere of the normal, with a cosine
+ * distribution : each brings the light absorbed where it lands times
+ * the color and the absorption of that surface, so that their mean is in
+ * the unit of the photon estimate. The photons are not reflected by the
+ * absorbing surfaces : this adds the first diffuse bounce of the light.
+ * The result is interpolated from the irradiance cache when possible.
+ */
+Color PhotonMappingBased::gather_flux(const Point3D& point, const Vector3D& normal, const Scene& sc,
+        NearestPhotons& np, Sampler& sampler, GatherContext& gather) const
+{
+	Color irradiance(0.0, 0.0, 0.0) ;
 
-		if(depth == 0)
-			return absorbed_illumination ;
-		else
-		{
-			double refraction_prob = -1.0 ;
-			Volume *vol ;
-			Surface *surf ;
+	if (gather.cache != NULL && gather.cache->interpolate(point, normal, irradiance))
+		return irradiance ;
 
-			vol = dynamic_cast< Volume* >( (*final_it).get() ) ;
-			if(vol != 0)
-				refraction_prob = vol->get_refraction_prob() ;
+	int nb_rays = GlobalParameters::get_unique_instance()->get_final_gather_rays() ;
 
-			surf = dynamic_cast< Surface* >( (*final_it).get() ) ;
-			if(surf != 0)
-				refraction_prob = surf->get_transparency_prob() ;
+	// Frame around the normal
+	Vector3D u = ((std::abs(normal[0]) > 0.5) ? Vector3D(0, 1, 0) : Vector3D(1, 0, 0)).cross(normal).normalized() ;
+	Vector3D v = normal.cross(u) ;
 
-			if(refraction_prob <= 0.0)
-				refraction_prob = 0.0 ;
+	double r, g, b, sum_inverse_distances ;
+	r = g = b = sum_inverse_distances = 0.0 ;
 
-			double reflection_prob = (*final_it)->get_reflection_prob() ;
-			double absorption_prob = (*final_it)->get_absorption_prob() ;
+	for (int k = 0; k < nb_rays; k++)
+	{
+		// Uniform point of the unit disk, lifted on the hemisphere
+		double radius = sqrt(sampler.next_double()) ;
+		double angle = 2.0 * M_PI * sampler.next_double() ;
+		Vector3D direction = (radius * cos(angle)) * u + (radius * sin(angle)) * v
+			+ sqrt(std::max(0.0, 1.0 - radius * radius)) * normal ;
+
+		Ray ray(point, direction) ;
+		ray.leave_surface() ;
+		Hit hit = sc.intersect_nearest(ray) ;
+		if (!hit.is_found())
+			continue ;
+		sum_inverse_distances += 1.0 / hit.distance ;
+
+		// The light sources are already counted by the direct lighting or the photons
+		if (is_radiant_volume(hit.shape, sc))
+			continue ;
+
+		Vector3D hit_normal = hit.couple.second ;
+		if (hit_normal.dot(direction) > 0)
+			hit_normal = -hit_normal ;
+
+		Color flux = get_flux(hit.couple.first, hit_normal, sc, np, sampler, 1) ;
+		Color there = hit.shape->get_color_at(hit.couple.first) ;
+		double absorption = hit.shape->get_absorption_prob() ;
+
+		r += flux.get_r() * there.get_r() * absorption ;
+		g += flux.get_g() * there.get_g() * absorption ;
+		b += flux.get_b() * there.get_b() * absorption ;
+	}
 
-			r =
-					reflected_illumination.get_r() * reflection_prob
-					+ refracted_illumination.get_r() * refraction_prob
-					+ absorbed_illumination.get_r() * absorption_prob ;
+	if (nb_rays > 0)
+		irradiance = Color(r / nb_rays, g / nb_rays, b / nb_rays) ;
 
-			g =
-					reflected_illumination.get_g() * reflection_prob
-					+ refracted_illumination.get_g() * refraction_prob
-					+ absorbed_illumination.get_g() * absorption_prob ;
+	// Nothing around : no record, whose area of influence would be infinite
+	if (gather.new_records != NULL && sum_inverse_distances > 0.0)
+		gather.new_records->push_back(IrradianceRecord(point, normal, irradiance, nb_rays / sum_inverse_distances)) ;
 
-			b =
-					reflected_illumination.get_b() * reflection_prob
-					+ refracted_illumination.get_b() * refraction_prob
-					+ absorbed_illumination.get_b() * absorption_prob ;
+	return irradiance ;
+}
 
-			return Color(r, g, b) ;
-		}
+/**
+ * \brief Returns whether a shape is the volume of a RadiantVolume of the scene
+ * \param shape : the shape to look for
+ * \param sc : the scene containing the lights
+ */
+bool PhotonMappingBased::is_radiant_volume(const Shape *shape, const Scene& sc)
+{
+	for (unsigned int i = 0; i < sc.get_light_list().size(); i++)
+	{
+		const RadiantVolume *radiant = dynamic_cast<const RadiantVolume*>(sc.get_light_list()[i].get()) ;
+		if (radiant != NULL && &radiant->get_volume() == shape)
+			return true ;
 	}
-	else
-		return Color(0.0, 0.0, 0.0) ;
+	return false ;
 }
@@ -11,6 +11,7 @@
 #include <boost/smart_ptr/shared_ptr.hpp>
 #include "raytracer.hpp"
 #include "photon_mapper.hpp"
+#include "irradiance_cache.hpp"
 #include "global_parameters.hpp"
 #include "launchables/ray.hpp"
 
@@ -23,23 +24,107 @@ public:
     /**
 	 * \brief Constructor
 	 * \param sc : the scene to photon-trace
+	 * \param photon_map_filename : photon map file saved by a previous run, if any
      *
      * Directly calls the build_photon_tree method (photon_mapping phase)
-     * thus creating the photon_maps
+     * thus creating the photon_maps, unless they can be read from the file.
+     * The progressive photon mapping emits its photons while rendering :
+     * its photon maps are left empty.
 	 */
-    PhotonMappingBased(const Scene& sc) :
+    PhotonMappingBased(const Scene& sc, const std::string& photon_map_filename = "") :
     	_photon_mapper(
     			sc,
-    			GlobalParameters::get_unique_instance()->get_nb_photon_MAX(),
-    			GlobalParameters::get_unique_instance()->get_photon_depth()
+    			upfront(GlobalParameters::get_unique_instance()->get_nb_photon_MAX()),
+    			upfront(GlobalParameters::get_unique_instance()->get_nb_caustic_photon_MAX()),
+    			GlobalParameters::get_unique_instance()->get_photon_depth(),
+    			upfront(GlobalParameters::get_unique_instance()->get_irradiance_photon_step()),
+    			photon_map_filename
     		) {}
     Image render(const Scene&) const ;              ///< Returns an Image with the given scene
     Image render_photonmap(const Scene&) const ;    ///< Returns an Image of the photon-map of the scene
+    bool save_photon_map(const std::string& filename) const { return _photon_mapper.save(filename) ; } ///< Writes the photon map into a file, to be reused by later runs
 
 private:
+    /**
+     * \struct GatherContext
+     * \brief Irradiance cache of the final gathering, as seen by one rendering task
+     */
+    struct GatherContext
+    {
+        const IrradianceCache *cache ; ///< Records of the previous passes, NULL to gather at each point
+        std::vector<IrradianceRecord> *new_records ; ///< Where the task adds the records it gathers, NULL when they would not be added to the cache
+    };
+
+    /**
+     * \struct HitPoint
+     * \brief Point of an absorbing surface seen from a pixel, gathering the photons of the progressive passes
+     *
+     * Holds the statistics of the progressive photon mapping (Hachisuka) :
+     * only they are kept from one pass to the next, not the photons.
+     */
+    struct HitPoint
+    {
+        /**
+         * \brief Constructor of a point not reached by any photon yet
+         * \param pos : the point of the surface
+         * \param norm : the normal at this point, on the side of the viewer
+         * \param w : the part of the light absorbed there that reaches the pixel
+         * \param dir : the direct lighting at this point, in the unit of the photon estimate
+         * \param pix : the index of the pixel
+         */
+        HitPoint(const Point3D& pos, const Vector3D& norm, const Color& w, const Color& dir, unsigned int pix) :
+            position(pos), normal(norm), weight(w), direct(dir), pixel(pix), radius2(0.0), nb_photons(0.0)
+        { flux[0] = flux[1] = flux[2] = 0.0 ; }
+
+        Point3D position ; ///< Point of the surface
+        Vector3D normal ; ///< Normal at this point, on the side of the viewer
+        Color weight ; ///< Part of the light absorbed there that reaches the pixel, color of the surface included
+        Color direct ; ///< Direct lighting, traced once with shadow rays
+        unsigned int pixel ; ///< Index of the pixel, j * res_x + i
+        double radius2 ; ///< Squared radius of the gathering, 0 until the first photons were found around
+        double nb_photons ; ///< Photons accumulated so far, reduced at each pass as the radius shrinks
+        double flux[3] ; ///< Power of the accumulated photons, reduced with the radius
+    };
+
+    /**
+     * \struct PathVertex
+     * \brief Ray waiting to be traced by trace_paths()
+     */
+    struct PathVertex
+    {
+        /**
+         * \brief Constructor
+         * \param r : the ray to trace
+         * \param w : the part of the light coming along the ray that reaches the pixel
+         * \param d : the remaining number of reflections/refractions
+         */
+        PathVertex(const Ray& r, const Color& w, int d) : ray(r), weight(w), depth(d) {}
+
+        Ray ray ; ///< Ray to trace
+        Color weight ; ///< Part of the light coming along the ray that reaches the pixel
+        int depth ; ///< Remaining number of reflections/refractions
+    };
+
+    typedef std::vector<PathVertex> PathStack ; ///< Rays waiting to be traced, one stack reused by each thread
+
     PhotonMapper _photon_mapper; ///< Contains the photon_mapper used for the scene
 
-    Color get_local_color(Ray, const Scene&, int depth_level) const ; ///< Aimed recursive, calculates the color of a point
+    /**
+     * \brief Number of photons to emit before rendering
+     * \param nb_photons : the number asked for in the scene file
+     */
+    static int upfront(int nb_photons) { return (GlobalParameters::get_unique_instance()->get_progressive_passes() > 0) ? 0 : nb_photons ; }
+
+    void render_progressive(const Scene&, const Color& coef, Image& img) const ; ///< Renders img with the progressive photon mapping
+    void collect_hit_points(const Ray&, const Scene&, int depth_level, unsigned int pixel, Sampler&, PathStack&, std::vector<HitPoint>&) const ; ///< Finds the absorbing points seen by a ray
+    template<typename AbsorbFunctor>
+    void trace_paths(const Ray&, const Scene&, int depth_level, Sampler&, PathStack&, AbsorbFunctor&, const Hit* first_hit = NULL) const ; ///< Follows a ray through the reflections/refractions, calling the functor at each absorbing surface
+
+    Color get_local_color(const Ray&, const Scene&, int depth_level, NearestPhotons&, Sampler&, GatherContext*, PathStack&, const Hit* first_hit = NULL) const ; ///< Calculates the color seen by a ray
+    Color get_flux(const Point3D&, const Vector3D&, const Scene&, NearestPhotons&, Sampler&, unsigned int) const ; ///< Light absorbed at a point, direct lighting and photon estimates
+    Color get_direct_flux(const Point3D&, const Vector3D&, const Scene&, Sampler&, unsigned int) const ; ///< Direct lighting at a point, traced with shadow rays
+    Color gather_flux(const Point3D&, const Vector3D&, const Scene&, NearestPhotons&, Sampler&, GatherContext&) const ; ///< Light reflected towards a point by the surfaces around, interpolated from the irradiance cache when possible
+    static bool is_radiant_volume(const Shape*, const Scene&) ; ///< Whether a shape emits light
 };
 
 #endif
@@ -0,0 +1,165 @@
+#ifndef STORED_PHOTON_HPP_
+#define STORED_PHOTON_HPP_
+
+/**
+ * \file stored_photon.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of struct StoredPhoton
+ */
+
+#include <cmath>
+#include "geometry.hpp"
+#include "color.hpp"
+
+/**
+ * \struct StoredPhoton
+ * \brief Compact record of an absorbed photon kept in the photon map
+ *
+ * Twenty bytes per photon : single precision position, direction
+ * packed in two angles (Jensen) and power in shared-exponent RGB (Ward's RGBE).
+ * Photons are stored by value in one contiguous array, the precision
+ * lost is far below the noise of the density estimation.
+ */
+struct StoredPhoton
+{
+	/**
+	 * \brief Flags describing how the photon was stored
+	 */
+	enum Flags
+	{
+		EMITTED = 1, ///< Stored at its emission point (radiant volumes)
+		CAUSTIC = 2, ///< Reflected or refracted at least once before being absorbed
+		IRRADIANCE = 4 ///< Its power is the flux estimated at its position by the whole map (PhotonMapper::precompute_irradiance())
+	};
+
+	float position[3] ; ///< Position of the photon
+	unsigned char theta ; ///< Polar angle of the incoming direction, 256 steps over [0, pi]
+	unsigned char phi ; ///< Azimuthal angle of the incoming direction, 256 steps over [-pi, pi]
+	unsigned char power[4] ; ///< Power in RGBE : three mantissas and a shared exponent
+	unsigned char flags ; ///< Combination of Flags
+	unsigned char reserved ; ///< Zero, pads the photon to 20 bytes
+
+	StoredPhoton() {} ///< Uninitialised photon, for arrays
+
+	/**
+	 * \brief Constructor packing a photon
+	 * \param pos : position of the photon
+	 * \param dir : incoming direction of the photon (normalized)
+	 * \param col : power of the photon
+	 * \param fl : combination of Flags
+	 */
+	StoredPhoton(const Point3D& pos, const Vector3D& dir, const Color& col, unsigned char fl = 0) :
+		flags(fl), reserved(0)
+	{
+		position[0] = (float)pos[0] ;
+		position[1] = (float)pos[1] ;
+		position[2] = (float)pos[2] ;
+		set_direction(dir) ;
+		set_power(col) ;
+	}
+
+	Point3D get_position() const { return Point3D(position[0], position[1], position[2]) ; } ///< Returns the position of the photon
+
+	/**
+	 * \brief Returns the squared distance between the photon and a point
+	 * \param point : the point to compare with
+	 */
+	double squared_distance(const Point3D& point) const
+	{
+		double dx = position[0] - point[0] ;
+		double dy = position[1] - point[1] ;
+		double dz = position[2] - point[2] ;
+		return dx*dx + dy*dy + dz*dz ;
+	}
+
+	/**
+	 * \brief Packs the direction into theta and phi
+	 * \param dir : normalized direction
+	 */
+	void set_direction(const Vector3D& dir)
+	{
+		double z = dir[2] ;
+		if (z > 1.0) z = 1.0 ;
+		if (z < -1.0) z = -1.0 ;
+		int t = (int)(acos(z) * (256.0 / M_PI)) ;
+		int p = (int)((atan2(dir[1], dir[0]) + M_PI) * (256.0 / (2.0 * M_PI))) ;
+		theta = (unsigned char)((t > 255) ? 255 : t) ;
+		phi = (unsigned char)((p > 255) ? 255 : p) ;
+	}
+
+	/**
+	 * \brief Returns the unpacked direction of the photon
+	 *
+	 * Uses tables of sines and cosines computed once
+	 */
+	Vector3D get_direction() const
+	{
+		static const DirectionTables tables ;
+		return Vector3D(
+				tables.sin_theta[theta] * tables.cos_phi[phi],
+				tables.sin_theta[theta] * tables.sin_phi[phi],
+				tables.cos_theta[theta]
+			) ;
+	}
+
+	/**
+	 * \brief Packs the power in RGBE
+	 * \param col : the power, components must be positive
+	 */
+	void set_power(const Color& col)
+	{
+		double v = col.get_r() ;
+		if (col.get_g() > v) v = col.get_g() ;
+		if (col.get_b() > v) v = col.get_b() ;
+
+		if (v < 1e-32) {
+			power[0] = power[1] = power[2] = power[3] = 0 ;
+			return ;
+		}
+
+		int e ;
+		double scale = frexp(v, &e) * 256.0 / v ;
+		power[0] = (unsigned char)(col.get_r() * scale) ;
+		power[1] = (unsigned char)(col.get_g() * scale) ;
+		power[2] = (unsigned char)(col.get_b() * scale) ;
+		power[3] = (unsigned char)(e + 128) ;
+	}
+
+	/**
+	 * \brief Returns the unpacked power of the photon
+	 */
+	Color get_power() const
+	{
+		if (power[3] == 0) return Color(0.0, 0.0, 0.0) ;
+
+		double f = ldexp(1.0, (int)power[3] - (128 + 8)) ;
+		return Color((power[0] + 0.5) * f, (power[1] + 0.5) * f, (power[2] + 0.5) * f) ;
+	}
+
+private:
+	/**
+	 * \struct DirectionTables
+	 * \brief Precomputed sines and cosines of the packed angles
+	 */
+	struct DirectionTables
+	{
+		DirectionTables()
+		{
+			for (int i = 0; i < 256; i++) {
+				double angle = (i + 0.5) * (M_PI / 256.0) ;
+				cos_theta[i] = cos(angle) ;
+				sin_theta[i] = sin(angle) ;
+				angle = (i + 0.5) * (2.0 * M_PI / 256.0) - M_PI ;
+				cos_phi[i] = cos(angle) ;
+				sin_phi[i] = sin(angle) ;
+			}
+		}
+
+		double cos_theta[256] ; ///< Cosine of each value of theta
+		double sin_theta[256] ; ///< Sine of each value of theta
+		double cos_phi[256] ; ///< Cosine of each value of phi
+		double sin_phi[256] ; ///< Sine of each value of phi
+	};
+};
+
+#endif /* STORED_PHOTON_HPP_ */
@@ -0,0 +1,76 @@
+#ifndef SAMPLER_HPP_
+#define SAMPLER_HPP_
+
+/**
+ * \file sampler.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of class Sampler
+ */
+
+#include <cmath>
+#include <stdint.h>
+#include "geometry.hpp"
+
+/**
+ * \class Sampler
+ * \brief Random number generator owned by a single photon (PCG32)
+ *
+ * Permuted congruential generator (O'Neill) : 64 bits of state and a
+ * stream selector, so that every (seed, stream) couple gives its own
+ * independent sequence. The photon mapper gives each photon the stream
+ * of its index : the random choices made for a photon do not depend on
+ * which thread traces it nor on the photons traced before.
+ */
+class Sampler
+{
+public:
+	/**
+	 * \brief Constructor
+	 * \param seed : seed of the whole run
+	 * \param stream : index of the sequence, usually the photon index
+	 */
+	Sampler(uint64_t seed, uint64_t stream) :
+		_state(0), _increment((stream << 1u) | 1u)
+	{
+		next_uint() ;
+		_state += seed ;
+		next_uint() ;
+	}
+
+	/**
+	 * \brief Returns a uniformly distributed 32 bits integer
+	 */
+	uint32_t next_uint()
+	{
+		uint64_t old_state = _state ;
+		_state = old_state * 6364136223846793005ULL + _increment ;
+		uint32_t xorshifted = (uint32_t)(((old_state >> 18u) ^ old_state) >> 27u) ;
+		uint32_t rot = (uint32_t)(old_state >> 59u) ;
+		return (xorshifted >> rot) | (xorshifted << ((-rot) & 31)) ;
+	}
+
+	double next_double() { return next_uint() * (1.0 / 4294967296.0) ; } ///< Returns a uniformly distributed number in [0, 1)
+
+	/**
+	 * \brief Returns a unit vector uniformly distributed over the directions
+	 *
+	 * Draws points of the cube [-1, 1)^3 until one falls in the unit ball :
+	 * normalizing a point of the cube itself would favour its corners
+	 */
+	Vector3D next_unit_vector()
+	{
+		Vector3D v ;
+		double norm_2 ;
+		do {
+			v = Vector3D(2.0 * next_double() - 1.0, 2.0 * next_double() - 1.0, 2.0 * next_double() - 1.0) ;
+			norm_2 = v.squaredNorm() ;
+		} while (norm_2 > 1.0 || norm_2 < 1e-12) ;
+		return v / sqrt(norm_2) ;
+	}
+
+private:
+	uint64_t _state ; ///< Current state of the generator
+	uint64_t _increment ; ///< Odd increment selecting the stream
+};
+
+#endif /* SAMPLER_HPP_ */
@@ -0,0 +1,325 @@
+/**
+ * \file scene.cpp
+ * \brief Implementation of class Scene
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include <cmath>
+#include "scene.hpp"
+#include "shapes/sphere.hpp"
+#include "shapes/plane.hpp"
+#include "shapes/triangle.hpp"
+#include "shapes/parallelepiped.hpp"
+
+/**
+ * \param shape : the shape to store
+ *
+ * The shapes of type OTHER keep no geometry here,
+ * they are intersected through their virtual functions
+ */
+PrimitiveRef ScenePrimitives::add(const Shape* shape)
+{
+	PrimitiveRef ref;
+	ref.type = shape->get_type();
+	ref.index = 0;
+	ref.shape = shape;
+
+	switch (ref.type) {
+	case Shape::SPHERE:
+		ref.index = spheres.size();
+		spheres.push_back(static_cast<const Sphere*>(shape)->get_primitive());
+		break;
+	case Shape::PLANE:
+		ref.index = planes.size();
+		planes.push_back(static_cast<const Plane*>(shape)->get_primitive());
+		break;
+	case Shape::TRIANGLE:
+		ref.index = triangles.size();
+		triangles.push_back(static_cast<const Triangle*>(shape)->get_primitive());
+		break;
+	case Shape::PARALLELEPIPED:
+		ref.index = parallelepipeds.size();
+		parallelepipeds.push_back(static_cast<const Parallelepiped*>(shape)->get_primitive());
+		break;
+	default:
+		break;
+	}
+	return ref;
+}
+
+void ScenePrimitives::clear()
+{
+	spheres.clear();
+	planes.clear();
+	triangles.clear();
+	parallelepipeds.clear();
+}
+
+/**
+ * \brief Finds the distance of a shape closer than t_max with the kernel of its type
+ *
+ * Only the shapes of type OTHER go through the vtable
+ */
+static inline bool intersect_primitive(const ScenePrimitives& primitives, const PrimitiveRef& ref,
+	const Launchable& l, double t_max, double& distance)
+{
+	switch (ref.type) {
+	case Shape::SPHERE: return primitives.spheres[ref.index].intersect(l, t_max, distance);
+	case Shape::PLANE: return primitives.planes[ref.index].intersect(l, t_max, distance);
+	case Shape::TRIANGLE: return primitives.triangles[ref.index].intersect(l, t_max, distance);
+	case Shape::PARALLELEPIPED: return primitives.parallelepipeds[ref.index].intersect(l, t_max, distance);
+	default: {
+		Hit hit;
+		if (!ref.shape->intersect(l, t_max, hit)) return false;
+		distance = hit.distance;
+		return true;
+	}
+	}
+}
+
+/**
+ * \brief Returns whether a shape is met closer than t_max, with the kernel of its type
+ */
+static inline bool primitive_is_intersected_by(const ScenePrimitives& primitives, const PrimitiveRef& ref,
+	const Launchable& l, double t_max)
+{
+	double distance;
+	switch (ref.type) {
+	case Shape::SPHERE: return primitives.spheres[ref.index].is_intersected_by(l, t_max);
+	case Shape::OTHER: return ref.shape->is_intersected_by(l, t_max);
+	default: return intersect_primitive(primitives, ref, l, t_max, distance);
+	}
+}
+
+/**
+ * \brief Intersects the shapes reached in the BVH leaves
+ *
+ * Keeps the nearest shape found so far, and lowers the maximum distance
+ * of the traversal accordingly. The kernels only give distances : the
+ * Hit is completed once by the nearest shape. The shapes of type OTHER
+ * give their Hit at once, it is kept as long as they are the nearest
+ */
+struct NearestIntersector
+{
+	NearestIntersector(const Launchable& l, const ScenePrimitives& primitives,
+		const std::vector<PrimitiveRef>& refs, const Shape*& nearest, Hit& hit) :
+			_l(l), _primitives(primitives), _refs(refs), _nearest(nearest), _hit(hit) {}
+
+	void operator()(unsigned int primitive, double& t_max)
+	{
+		const PrimitiveRef& ref = _refs[primitive];
+		double distance;
+
+		if (ref.type == Shape::OTHER) {
+			if (ref.shape->intersect(_l, t_max, _hit)) {
+				t_max = _hit.distance;
+				_nearest = ref.shape;
+			}
+		}
+		else if (intersect_primitive(_primitives, ref, _l, t_max, distance)) {
+			t_max = distance;
+			_nearest = ref.shape;
+		}
+	}
+
+	const Launchable& _l ; ///< The launchable being traced
+	const ScenePrimitives& _primitives ; ///< Geometry of the shapes of the scene
+	const std::vector<PrimitiveRef>& _refs ; ///< Reference of each primitive
+	const Shape*& _nearest ; ///< The nearest shape so far
+	Hit& _hit ; ///< Hit of the nearest shape of type OTHER so far
+};
+
+/**
+ * \brief Intersects the shapes reached in the BVH leaves with the lanes of a packet
+ *
+ * The shapes lower the distance of the lanes they are met on
+ * and record themselves as the nearest shape of these lanes
+ */
+struct PacketIntersector
+{
+	PacketIntersector(const RayPacket& packet, const ScenePrimitives& primitives,
+		const std::vector<PrimitiveRef>& refs, const Shape* hit_shapes[]) :
+			_packet(packet), _primitives(primitives), _refs(refs), _hit_shapes(hit_shapes) {}
+
+	void operator()(unsigned int primitive, Double4& t_max, int lanes)
+	{
+		const PrimitiveRef& ref = _refs[primitive];
+		double distances[RayPacket::SIZE];
+		int found = 0;
+
+		switch (ref.type) {
+		case Shape::SPHERE:
+			found = _primitives.spheres[ref.index].intersect_packet(_packet, lanes, t_max, distances);
+			break;
+		case Shape::PLANE:
+			found = _primitives.planes[ref.index].intersect_packet(_packet, lanes, t_max, distances);
+			break;
+		case Shape::TRIANGLE:
+			found = _primitives.triangles[ref.index].intersect_packet(_packet, lanes, t_max, distances);
+			break;
+		case Shape::PARALLELEPIPED:
+			found = _primitives.parallelepipeds[ref.index].intersect_packet(_packet, lanes, t_max, distances);
+			break;
+		default: // no SIMD kernel, the shape goes one lane at a time
+			ref.shape->intersect_packet(_packet, lanes, t_max, _hit_shapes);
+			return;
+		}
+		if (found == 0) return;
+
+		double t[RayPacket::SIZE];
+		t_max.store(t);
+		for (int i = 0; i < RayPacket::SIZE; i++)
+			if ((found >> i) & 1) {
+				t[i] = distances[i];
+				_hit_shapes[i] = ref.shape;
+			}
+		t_max = Double4(t[0], t[1], t[2], t[3]);
+	}
+
+	const RayPacket& _packet ; ///< The launchables being traced
+	const ScenePrimitives& _primitives ; ///< Geometry of the shapes of the scene
+	const std::vector<PrimitiveRef>& _refs ; ///< Reference of each primitive
+	const Shape** _hit_shapes ; ///< The nearest shape of each lane so far
+};
+
+/**
+ * \brief Intersects the shapes reached in the BVH leaves until one is hit
+ *
+ * Any hit within the segment is enough : the first one found
+ * drops the maximum distance to 0, which ends the traversal.
+ * The shapes are only asked whether they are hit, not where
+ */
+struct AnyIntersector
+{
+	AnyIntersector(const Launchable& l, const ScenePrimitives& primitives,
+		const std::vector<PrimitiveRef>& refs) :
+			_l(l), _primitives(primitives), _refs(refs), _found(false) {}
+
+	void operator()(unsigned int primitive, double& t_max)
+	{
+		if (primitive_is_intersected_by(_primitives, _refs[primitive], _l, t_max)) {
+			_found = true;
+			t_max = 0;
+		}
+	}
+
+	const Launchable& _l ; ///< The launchable being traced
+	const ScenePrimitives& _primitives ; ///< Geometry of the shapes of the scene
+	const std::vector<PrimitiveRef>& _refs ; ///< Reference of each primitive
+	bool _found ; ///< Whether a shape was hit
+};
+
+/**
+ * Copies the geometry of the shapes in the arrays of their types, and sorts
+ * them between the bounded ones, put in the BVH, and the unbounded ones
+ * (planes) which are tested one by one before the traversal
+ */
+void Scene::build_acceleration_structure()
+{
+	std::vector<BoundingBox> boxes;
+	_primitives.clear();
+	_bounded.clear();
+	_unbounded.clear();
+
+	for (unsigned int i = 0; i < _shape_list.size(); i++) {
+		PrimitiveRef ref = _primitives.add(_shape_list[i].get());
+		BoundingBox box;
+		if (_shape_list[i]->get_bounding_box(box)) {
+			_bounded.push_back(ref);
+			boxes.push_back(box);
+		}
+		else
+			_unbounded.push_back(ref);
+	}
+
+	_bvh.build(boxes);
+}
+
+/**
+ * \param l : the launchable to trace
+ *
+ * The unbounded shapes are tested first so that their
+ * distance already prunes the traversal of the BVH.
+ * The nearest shape then computes its Hit alone, just
+ * beyond the distance its kernel found
+ */
+Hit Scene::intersect_nearest(const Launchable& l) const
+{
+	Hit hit;
+	const Shape* nearest = NULL;
+	double t_max = l.get_t_max();
+
+	NearestIntersector unbounded_intersector(l, _primitives, _unbounded, nearest, hit);
+	for (unsigned int i = 0; i < _unbounded.size(); i++)
+		unbounded_intersector(i, t_max);
+
+	NearestIntersector bounded_intersector(l, _primitives, _bounded, nearest, hit);
+	_bvh.traverse(l, t_max, bounded_intersector);
+
+	if (nearest != NULL && nearest != hit.shape)
+		nearest->intersect(l, std::nextafter(t_max, std::numeric_limits<double>::max()), hit);
+	return hit;
+}
+
+/**
+ * \param packet : the launchables to trace
+ * \param hits : filled with the nearest intersection of each active lane
+ *
+ * The lanes go together through the unbounded shapes and the BVH,
+ * which only finds the nearest shape of each lane : its Hit is then
+ * computed by this shape alone, just beyond the distance found for
+ * the lane, as intersect_nearest() would.
+ */
+void Scene::intersect_packet(const RayPacket& packet, Hit hits[]) const
+{
+	Double4 t_max = packet.t_max;
+	const Shape* hit_shapes[RayPacket::SIZE] = { NULL, NULL, NULL, NULL };
+
+	PacketIntersector unbounded_intersector(packet, _primitives, _unbounded, hit_shapes);
+	for (unsigned int i = 0; i < _unbounded.size(); i++)
+		unbounded_intersector(i, t_max, packet.active);
+
+	PacketIntersector bounded_intersector(packet, _primitives, _bounded, hit_shapes);
+	_bvh.traverse_packet(packet, t_max, bounded_intersector);
+
+	double distances[RayPacket::SIZE];
+	t_max.store(distances);
+	for (int i = 0; i < RayPacket::SIZE; i++) {
+		if (!((packet.active >> i) & 1)) continue;
+		hits[i] = Hit();
+		if (hit_shapes[i] == NULL) continue;
+		Launchable l = packet.get_launchable(i);
+		if (!hit_shapes[i]->intersect(l, std::nextafter(distances[i], std::numeric_limits<double>::max()), hits[i]))
+			hits[i] = intersect_nearest(l); // the scalar test disagrees, it has the last word
+	}
+}
+
+/**
+ * \param origin : start of the segment, usually a point of a surface
+ * \param target : end of the segment, usually a point of a light
+ *
+ * Shadow ray query : contrary to intersect_nearest(), the first shape
+ * found between the points is enough. The interval of the segment leaves
+ * out a surface epsilon at both ends, so that the surfaces the points
+ * lie on do not occlude them.
+ */
+bool Scene::occluded(const Point3D& origin, const Point3D& target) const
+{
+	Vector3D to_target = target - origin;
+	double distance = to_target.norm();
+	if (distance <= 2*Launchable::SURFACE_EPSILON) return false;
+
+	Vector3D direction = to_target / distance;
+	Launchable l(origin, direction);
+	l.set_interval(Launchable::SURFACE_EPSILON, distance - Launchable::SURFACE_EPSILON);
+	double t_max = l.get_t_max();
+
+	AnyIntersector unbounded_intersector(l, _primitives, _unbounded);
+	for (unsigned int i = 0; i < _unbounded.size() && !unbounded_intersector._found; i++)
+		unbounded_intersector(i, t_max);
+	if (unbounded_intersector._found) return true;
+
+	AnyIntersector bounded_intersector(l, _primitives, _bounded);
+	_bvh.traverse(l, t_max, bounded_intersector);
+	return bounded_intersector._found;
+}
@@ -8,17 +8,48 @@
  */
 
 #include <vector>
+#include <stdint.h>
 #include <boost/smart_ptr/shared_ptr.hpp>
 #include <cameras/camera.hpp>
 #include <shapes/shape.hpp>
+#include <shapes/hit.hpp>
+#include <shapes/primitives.hpp>
 #include "lights/light.hpp"
+#include "raytracing/bvh.hpp"
+
+/**
+ * \struct PrimitiveRef
+ * \brief Tagged index of a shape of the scene in the array of its type
+ */
+struct PrimitiveRef
+{
+	Shape::Type type ; ///< Type of the shape, telling which array holds its geometry
+	unsigned int index ; ///< Index in this array, unused for the type OTHER
+	const Shape* shape ; ///< The shape itself, which completes the Hit once it is the nearest
+};
+
+/**
+ * \struct ScenePrimitives
+ * \brief Geometry of the shapes of the scene, one contiguous array per type
+ */
+struct ScenePrimitives
+{
+	std::vector<SpherePrimitive> spheres ; ///< Geometry of the spheres
+	std::vector<PlanePrimitive> planes ; ///< Geometry of the planes
+	std::vector<TrianglePrimitive> triangles ; ///< Geometry of the triangles
+	std::vector<ParallelepipedPrimitive> parallelepipeds ; ///< Geometry of the parallelepipeds
+
+	PrimitiveRef add(const Shape*) ; ///< Stores the geometry of a shape in the array of its type, returns its reference
+	void clear() ; ///< Empties all the arrays
+};
 
 /**
  * \class Scene
  * \brief Entirely describes a scene (lights/objects/camera)
  *
- * It contains a list of lights, a list of shapes and a camera
- *
+ * It contains a list of lights, a list of shapes and a camera.
+ * Once all the shapes are added, build_acceleration_structure()
+ * must be called before intersecting launchables with the scene
  */
 class Scene
 {
@@ -26,7 +57,7 @@ public:
     /**
     * \brief Basic constructor of class Scene
     */
-    Scene() {}
+    Scene() : _content_hash(0) {}
     /**
 	 * \brief Complete constructor of class Scene
 	 *
@@ -37,7 +68,7 @@ public:
     Scene(boost::shared_ptr<Camera> camera,
     		std::vector< boost::shared_ptr<Shape> > shape_list,
     		std::vector< boost::shared_ptr<Light> > light_list) :
-        _camera(camera), _shape_list(shape_list), _light_list(light_list) {}
+        _camera(camera), _shape_list(shape_list), _light_list(light_list), _content_hash(0) {}
 
     void add_camera(boost::shared_ptr<Camera> camera) {_camera = camera; } ///< Add/change the Camera of this scene
     void add_shape(boost::shared_ptr<Shape> shape) {_shape_list.push_back(shape); } ///< Adds a new Shape to this scene
@@ -58,10 +89,24 @@ public:
     	return _light_list;
     }
 
+    void set_content_hash(uint64_t hash) { _content_hash = hash ; } ///< Sets the hash of the description of the shapes, textures and lights
+    uint64_t get_content_hash() const { return _content_hash ; } ///< Returns the hash of the description of the shapes, textures and lights (0 if unknown)
+
+    void build_acceleration_structure() ; ///< Builds the BVH over the bounded shapes, to be called once the scene is complete
+    Hit intersect_nearest(const Launchable&) const ; ///< Returns the nearest intersection of the given launchable with the shapes of this scene
+    void intersect_packet(const RayPacket&, Hit hits[]) const ; ///< Fills the nearest intersection of each active lane of a packet, tracing the lanes together
+    bool occluded(const Point3D& origin, const Point3D& target) const ; ///< Returns whether a shape lies between two points, stopping at the first one found
+
 private:
     boost::shared_ptr<Camera> _camera; ///< The camera of this scene
     std::vector< boost::shared_ptr<Shape> > _shape_list; ///< A list of shapes
     std::vector< boost::shared_ptr<Light> > _light_list; ///< A list of lights
+    uint64_t _content_hash; ///< Hash of the description of the shapes, textures and lights
+
+    BVH _bvh; ///< Hierarchy over the bounded shapes
+    ScenePrimitives _primitives; ///< Geometry of the shapes, by type
+    std::vector<PrimitiveRef> _bounded; ///< References of the shapes in the BVH, in the order of its primitives
+    std::vector<PrimitiveRef> _unbounded; ///< References of the infinite shapes, always tested
 };
 
 #endif
@@ -0,0 +1,138 @@
+#ifndef BOUNDING_BOX_HPP_
+#define BOUNDING_BOX_HPP_
+
+/**
+ * \file bounding_box.hpp
+ * \brief Declaration of class BoundingBox
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include <algorithm>
+#include <limits>
+#include "geometry.hpp"
+#include "launchables/ray_packet.hpp"
+
+/**
+ * \class BoundingBox
+ * \brief Axis-aligned box enclosing a Shape
+ *
+ * Used by the BVH to sort the shapes of the scene and
+ * to discard quickly the ones a Launchable can not reach
+ */
+class BoundingBox
+{
+public:
+    /**
+	 * \brief Constructor of an empty box
+	 *
+	 * The empty box has inverted bounds so that
+	 * the first extension gives the exact point
+	 */
+	BoundingBox() :
+		_min(Point3D::Constant(std::numeric_limits<double>::max())),
+		_max(Point3D::Constant(-std::numeric_limits<double>::max())) {}
+
+    /**
+	 * \brief Constructor of a box from its two extreme corners
+	 * \param min : the corner with the smallest coordinates
+	 * \param max : the corner with the biggest coordinates
+	 */
+	BoundingBox(const Point3D& min, const Point3D& max) :
+		_min(min), _max(max) {}
+
+	const Point3D& get_min() const { return _min ; } ///< Returns the corner with the smallest coordinates
+	const Point3D& get_max() const { return _max ; } ///< Returns the corner with the biggest coordinates
+	Point3D get_centroid() const { return 0.5 * (_min + _max) ; } ///< Returns the center of the box
+
+	bool is_empty() const { return _min[0] > _max[0] || _min[1] > _max[1] || _min[2] > _max[2] ; } ///< Returns whether the box contains nothing
+
+	bool contains(const Point3D& point) const ///< Returns whether the given point lies in the box, borders included
+	{
+		return point[0] >= _min[0] && point[0] <= _max[0]
+			&& point[1] >= _min[1] && point[1] <= _max[1]
+			&& point[2] >= _min[2] && point[2] <= _max[2];
+	}
+
+	void extend(const Point3D& point) ///< Grows the box so that it contains the given point
+	{
+		for (int i = 0; i < 3; i++) {
+			if (point[i] < _min[i]) _min[i] = point[i];
+			if (point[i] > _max[i]) _max[i] = point[i];
+		}
+	}
+
+	void extend(const BoundingBox& box) ///< Grows the box so that it contains the given box
+	{
+		if (box.is_empty()) return;
+		extend(box._min);
+		extend(box._max);
+	}
+
+	int get_largest_axis() const ///< Returns the axis (0, 1 or 2) along which the box is the longest
+	{
+		Vector3D extent = _max - _min;
+		if (extent[0] >= extent[1] && extent[0] >= extent[2]) return 0;
+		return (extent[1] >= extent[2]) ? 1 : 2;
+	}
+
+	double get_surface_area() const ///< Returns the area of the box, used by the surface area heuristic
+	{
+		if (is_empty()) return 0.0;
+		Vector3D extent = _max - _min;
+		return 2.0 * (extent[0]*extent[1] + extent[1]*extent[2] + extent[0]*extent[2]);
+	}
+
+	/**
+	 * \brief Slab test of a launchable against the box
+	 * \param start : origin of the launchable
+	 * \param inv_dir : componentwise inverse of the direction of the launchable
+	 * \param t_min : the box is ignored if the launchable leaves it before this distance
+	 * \param t_max : the box is ignored if farther than this distance
+	 *
+	 * Returns whether the launchable goes through the box between t_min and t_max
+	 */
+	bool is_intersected_by(const Point3D& start, const Vector3D& inv_dir, double t_min, double t_max) const
+	{
+		double t_near = t_min;
+		double t_far = t_max;
+
+		for (int i = 0; i < 3; i++) {
+			double t0 = (_min[i] - start[i]) * inv_dir[i];
+			double t1 = (_max[i] - start[i]) * inv_dir[i];
+			if (t0 > t1) std::swap(t0, t1);
+			if (t0 > t_near) t_near = t0;
+			if (t1 < t_far) t_far = t1;
+			if (t_near > t_far) return false;
+		}
+		return true;
+	}
+
+	/**
+	 * \brief Slab test of the launchables of a packet against the box
+	 * \param packet : the launchables to test
+	 * \param t_max : distance of each lane beyond which the box is ignored
+	 *
+	 * Returns the active lanes going through the box between their t_min and
+	 * their t_max, lane i as bit i
+	 */
+	int is_intersected_by(const RayPacket& packet, const Double4& t_max) const
+	{
+		Double4 t_near = packet.t_min;
+		Double4 t_far = t_max;
+
+		for (int i = 0; i < 3; i++) {
+			Double4 t0 = (Double4(_min[i]) - packet.origin[i]) * packet.inv_direction[i];
+			Double4 t1 = (Double4(_max[i]) - packet.origin[i]) * packet.inv_direction[i];
+			// min and max return their second operand when one is NaN (origin on a slab of a flat direction)
+			t_near = max(min(t0, t1), t_near);
+			t_far = min(max(t0, t1), t_far);
+		}
+		return (t_near <= t_far).mask() & packet.active;
+	}
+
+private:
+	Point3D _min ; ///< Corner with the smallest coordinates
+	Point3D _max ; ///< Corner with the biggest coordinates
+};
+
+#endif /* BOUNDING_BOX_HPP_ */
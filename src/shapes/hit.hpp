@@ -0,0 +1,31 @@
+#ifndef HIT_HPP_
+#define HIT_HPP_
+
+/**
+ * \file hit.hpp
+ * \brief Declaration of struct Hit
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include "geometry.hpp"
+
+class Shape;
+
+/**
+ * \struct Hit
+ * \brief Nearest intersection of a Launchable with the scene
+ *
+ * The shape is NULL when nothing was hit
+ */
+struct Hit
+{
+	Hit() : distance(-1.0), shape(NULL) {} ///< Constructor of an empty hit
+
+	double distance ; ///< Distance from the origin of the launchable to the intersection
+	Couple3D couple ; ///< Intersection point and normal at this point
+	const Shape* shape ; ///< The shape hit, NULL if none
+
+	bool is_found() const { return shape != NULL ; } ///< Returns whether a shape was hit
+};
+
+#endif /* HIT_HPP_ */
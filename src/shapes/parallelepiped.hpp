@@ -8,6 +8,7 @@
  */
 
 #include "volume.hpp"
+#include "primitives.hpp"
 
 /**
  * \class Parallelepiped
@@ -35,7 +36,8 @@ public:
 	 */
 	Parallelepiped(double absorp, double reflect, double refract, double index,
 		Texture* tex, Point3D corner, Vector3D x, Vector3D y, Vector3D z) :
-			Volume(absorp, reflect, refract, index, tex), _corner(corner), _x(x), _y(y), _z(z)
+			Volume(absorp, reflect, refract, index, tex), _corner(corner), _x(x), _y(y), _z(z),
+			_primitive(corner, x, y, z)
     {
         if ( std::abs(_x.dot(_y)) == 1 || std::abs(_y.dot(_z)) == 1 || std::abs(_x.dot(_z)) == 1 ) {
             std::cout << "CRITICAL FAILURE : One parallelepiped isn't really a parallelepiped (angle 0 or 180)" << std::endl;
@@ -45,21 +47,26 @@ public:
             std::cout << "CRITICAL FAILURE : One parallelepiped isn't really a parallelepiped (one null vector)" << std::endl;
             exit(EXIT_FAILURE);
         }
+        _type = PARALLELEPIPED;
+        init_texture_frame();
     }
 
-	bool is_intersected_by(const Launchable&) const ;  ///< Returns whether this parallelepiped is intersected by a given launchable
-	Couple3D get_nearest_intersection_with_normal(const Launchable&) const ; ///< Returns the nearest intersection (point/normal) of the given launchable with this parallelepiped
-	bool redirect_photon( const Couple3D&, Photon& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this parallelepiped
+	const ParallelepipedPrimitive& get_primitive() const { return _primitive ; } ///< Returns the geometry of this parallelepiped for the kernels of the Scene
+	bool intersect(const Launchable&, double t_max, Hit&) const ; ///< Finds in one pass the nearest intersection of the given launchable with this parallelepiped closer than t_max
+	bool redirect_photon( const Couple3D&, Photon&, Sampler& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this parallelepiped
 	std::pair<Ray, Ray> divide_ray( const Couple3D&, const Ray& ) const; ///< Returns the division (reflected/refracted) of an incoming ray at the couple position
-	Couple3D get_random_point_and_normal() const ; ///< Returns a random surface point and a random normal of the parallelepiped
+	Couple3D get_random_point_and_normal(Sampler&) const ; ///< Returns a random surface point and a random normal of the parallelepiped
+	Couple3D get_random_surface_point(Sampler&) const ; ///< Returns a random surface point of the parallelepiped and the outward normal at this point
 	Color get_color_at(const Point3D&) const; ///< Returns the color at this point of the parallelepiped
+	bool get_bounding_box(BoundingBox&) const ; ///< Fills the box enclosing this parallelepiped
 
 private:
-    inline Couple3D face_intersected_by(const Launchable& l, const Point3D& a, const Point3D& b, const Point3D& c, const Point3D& d) const; ///< Returns whether a face of the parallelepiped is intersected by the given launchable
-    inline Couple3D face_random_point_and_normal(const Point3D& a, const Point3D& b, const Point3D& c, const Point3D& d) const; ///< Generates random photons from a side of the parallelepiped
+	void init_texture_frame() ; ///< Fixes the frame of a procedural texture on the parallelepiped
+    inline Couple3D face_random_point_and_normal(const Point3D& a, const Point3D& b, const Point3D& c, const Point3D& d, Sampler& sampler) const; ///< Generates random photons from a side of the parallelepiped
 
 	Point3D _corner; ///< One hook point
 	Vector3D _x, _y, _z; ///< Direction and sizes of this parallelepiped
+	ParallelepipedPrimitive _primitive ; ///< Frame of the parallelepiped and its inverse, computed once for the slab test
 };
 
 #endif /* PARALLELEPIPED_HPP_ */
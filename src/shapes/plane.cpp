@@ -15,53 +15,31 @@
 /**
  * \param l : the incoming launchable to test
  * the collision with
+ * \param t_max : intersections farther than this distance are ignored
+ * \param hit : filled with the intersection if one is found
  *
  * This function returns whether the launchable direction
- * will lead to a collision with this plane
+ * will lead to a collision with this plane before t_max.
+ * The normal given in the hit faces the start of the launchable,
+ * it is the side the direction comes from
  */
-bool Plane::is_intersected_by(const Launchable& l) const
+bool Plane::intersect(const Launchable& l, double t_max, Hit& hit) const
 {
-    static double epsilon = 1e-7;
-	Point3D start = l.get_end_point() ;
-	Vector3D dir = l.get_direction() ;
-    if (std::abs(dir.dot(_normal)) < epsilon) return false;
-
-    Vector3D normal_facing_the_launch = _normal * _normal.dot( start - _one_point );
-    //if (normal_facing_the_launch.norm() < EPSILON) return false;
-
-	Point3D projection_of_start = start - normal_facing_the_launch;
-	//std::cout << "Projection of start [" << projection_of_start[0] << ", " << projection_of_start[1] << ", " << projection_of_start[2] << "]\n";
-    normal_facing_the_launch.normalize();
-	return (dir.dot(normal_facing_the_launch) < 0);
-}
-
-/**
- * \param l : the incoming launchable to find
- * intersection with
- *
- * This function returns a couple containing the nearest
- * intersection point (first param) with this plane and
- * the normal at intersection point (second param)
- */
-Couple3D Plane::get_nearest_intersection_with_normal(const Launchable& l) const
-{
-    //using namespace std;
-	Point3D start = l.get_end_point() ;
-	Vector3D dir = l.get_direction() ;
-
-	Point3D projection_of_start = start - _normal * _normal.dot( start - _one_point );
-	//cout << "Projection of start" << endl << projection_of_start << endl;
-    Vector3D proj_start = start - projection_of_start;
-    if (std::abs(dir.dot(_normal)) == 1) return Couple3D(projection_of_start, proj_start.normalized());
+    double distance;
+    if (!get_primitive().intersect(l, t_max, distance)) return false;
 
-    Point3D intersection = start + dir * (proj_start.norm())/(std::abs(dir.dot(_normal)));
-    //std::cout << "Intersection point :\n" <<intersection << "\n" << "Normal point :\n" <<proj_start.normalized() << "\n";
+	const Point3D& start = l.get_end_point() ;
+	const Vector3D& dir = l.get_direction() ;
 
-	return Couple3D(intersection, proj_start.normalized());
+    hit.distance = distance;
+    hit.couple = Couple3D(start + distance * dir, (_normal.dot(dir) < 0) ? _normal : Vector3D(-_normal));
+    hit.shape = this;
+	return true;
 }
 
 /**
  * \param ph : the incoming photon to redirect
+ * \param sampler : the random generator of the photon
  * \param couple : first parameter contains
  * the intersection point, second contains the normal
  * at this intersection
@@ -72,16 +50,15 @@ Couple3D Plane::get_nearest_intersection_with_normal(const Launchable& l) const
  * It returns TRUE is the photon was redirected, and
  * FALSE if the photon was absorbed
  */
-bool Plane::redirect_photon( const Couple3D& couple, Photon& ph ) const
+bool Plane::redirect_photon( const Couple3D& couple, Photon& ph, Sampler& sampler ) const
 {
     //using namespace std;
-    double number = (double)rand()/RAND_MAX;
-    static double epsilon = 1e-7;
+    double number = sampler.next_double();
 
     if (number < _reflection_prob) {
         ph.set_end_point(couple.first);
         ph.set_direction(ph.get_reflected(couple));
-        ph.set_end_point(ph.get_end_point() + ph.get_direction()*epsilon);
+        ph.leave_surface();
 
         Color ph_c = ph.get_color() ;
         Color shape_c = get_color_at(couple.first);
@@ -97,7 +74,7 @@ bool Plane::redirect_photon( const Couple3D& couple, Photon& ph ) const
     else if (number < _reflection_prob + _transparency_prob) {
         ph.set_end_point(couple.first);
         ph.set_direction(ph.get_refracted(couple, 1.0));
-        ph.set_end_point(ph.get_end_point() + ph.get_direction()*epsilon);
+        ph.leave_surface();
 
         Color ph_c = ph.get_color() ;
         Color shape_c = get_color_at(couple.first);
@@ -128,7 +105,6 @@ bool Plane::redirect_photon( const Couple3D& couple, Photon& ph ) const
 std::pair<Ray, Ray> Plane::divide_ray( const Couple3D& couple, const Ray& ray) const {
     Point3D intersection_point = couple.first;
 	Vector3D intersection_normal = couple.second;
-	static double epsilon = 1e-7;
 
     Ray reflected_ray(Point3D(0,0,0), Vector3D(0,0,0));
     Ray refracted_ray(Point3D(0,0,0), Vector3D(0,0,0));
@@ -137,7 +113,7 @@ std::pair<Ray, Ray> Plane::divide_ray( const Couple3D& couple, const Ray& ray) c
         reflected_ray = Ray(Point3D(0,0,0), Vector3D(0,0,0));
     else {
         reflected_ray = Ray(intersection_point, ray.get_reflected(couple));
-        reflected_ray.set_end_point(reflected_ray.get_end_point() + reflected_ray.get_direction()*epsilon);
+        reflected_ray.leave_surface();
     }
 
     if (_transparency_prob == 0)
@@ -145,7 +121,7 @@ std::pair<Ray, Ray> Plane::divide_ray( const Couple3D& couple, const Ray& ray) c
     else {
         //std::cout << ((ratio <= 1) ? "Entering surface\n" : "Getting out\n");
         refracted_ray = Ray(intersection_point, ray.get_refracted(couple, 1.0));
-        refracted_ray.set_end_point(refracted_ray.get_end_point() + refracted_ray.get_direction()*epsilon);
+        refracted_ray.leave_surface();
         //cout << "Getting refracted" << endl;
     }
 
@@ -154,6 +130,62 @@ std::pair<Ray, Ray> Plane::divide_ray( const Couple3D& couple, const Ray& ray) c
 
 
 /**
+ * Fixes once for all the texture frame (text_x/text_y) of a procedural
+ * texture so that it lies on the plane, choosing random
+ * vectors when the scene file gave none. Called by the constructor
+ * so that rendering only reads the frame, from any thread.
+ */
+void Plane::init_texture_frame()
+{
+    Procedural * proc = dynamic_cast<Procedural *>(_texture.get());
+    if (proc == NULL) return;
+
+    Vector3D x_vector = proc->get_text_x();
+    Vector3D y_vector = proc->get_text_y();
+
+    if (x_vector.norm() == 0 || y_vector.norm() == 0 || (std::abs(x_vector.dot(_normal)) == 1 && std::abs(y_vector.dot(_normal)) == 1)) {
+        do {
+            do {
+                x_vector = Vector3d::Random().normalized();
+
+            } while (x_vector.dot(_normal) <= 0.3 && x_vector.dot(_normal) > 0.7);
+            x_vector = (x_vector - x_vector.dot(_normal) * _normal).normalized();
+            //std::cout << std::endl << "Normlized error " << x_vector.dot(_normal);
+        } while (_normal.dot(x_vector) != 0);
+        y_vector = x_vector.cross(_normal).normalized();
+        proc->set_text_x(x_vector);
+        proc->set_text_y(y_vector);
+    }
+    else if (std::abs(x_vector.dot(_normal)) != 0 && std::abs(y_vector.dot(_normal)) != 0) {
+        Vector3D temp_vector;
+        if (std::abs(x_vector.dot(_normal)) != 1) {
+            temp_vector = _normal.cross(x_vector);
+            if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
+            temp_vector = _normal.cross(y_vector);
+            if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
+        }
+        else {
+            temp_vector = _normal.cross(y_vector);
+            if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
+            temp_vector = _normal.cross(x_vector);
+            if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
+        }
+        proc->set_text_x(x_vector);
+        proc->set_text_y(y_vector);
+    }
+    else if (std::abs(x_vector.dot(_normal)) == 0 && std::abs(y_vector.dot(_normal)) != 0) {
+        Vector3D temp_vector = _normal.cross(x_vector);
+        if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
+        proc->set_text_y(y_vector);
+    }
+    else if (std::abs(y_vector.dot(_normal)) == 0 && std::abs(x_vector.dot(_normal)) != 0) {
+        Vector3D temp_vector = _normal.cross(y_vector);
+        if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
+        proc->set_text_x(x_vector);
+    }
+}
+
+/**
  * \param inters_point : an intersection point where we seek the color
  *
  * This function determines the color at the given point of the surface
@@ -162,57 +194,12 @@ std::pair<Ray, Ray> Plane::divide_ray( const Couple3D& couple, const Ray& ray) c
  */
 Color Plane::get_color_at(const Point3D& inters_point) const
 {
-    if (dynamic_cast<Colored*>(_texture.get())) return _texture->get_color(0,0);
+    if (_texture->get_kind() == Texture::COLORED) return _texture->get_color(0,0);
 
-    Procedural * proc = dynamic_cast<Procedural *>(_texture.get());
+    Procedural * proc = static_cast<Procedural *>(_texture.get());
     Vector3D x_vector = proc->get_text_x();
     Vector3D y_vector = proc->get_text_y();
-    static bool never_checked = true;
 
-    if (never_checked) {
-        if (x_vector.norm() == 0 || y_vector.norm() == 0 || (std::abs(x_vector.dot(_normal)) == 1 && std::abs(y_vector.dot(_normal)) == 1)) {
-            do {
-                do {
-                    x_vector = Vector3d::Random().normalized();
-
-                } while (x_vector.dot(_normal) <= 0.3 && x_vector.dot(_normal) > 0.7);
-                Launchable test_launch((_one_point + x_vector), -_normal);
-                x_vector = (get_nearest_intersection_with_normal(test_launch).first - _one_point).normalized();
-                //std::cout << std::endl << "Normlized error " << x_vector.dot(_normal);
-            } while (_normal.dot(x_vector) != 0);
-            y_vector = x_vector.cross(_normal).normalized();
-            proc->set_text_x(x_vector);
-            proc->set_text_y(y_vector);
-        }
-        else if (std::abs(x_vector.dot(_normal)) != 0 && std::abs(y_vector.dot(_normal)) != 0) {
-            Vector3D temp_vector;
-            if (std::abs(x_vector.dot(_normal)) != 1) {
-                temp_vector = _normal.cross(x_vector);
-                if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
-                temp_vector = _normal.cross(y_vector);
-                if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
-            }
-            else {
-                temp_vector = _normal.cross(y_vector);
-                if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
-                temp_vector = _normal.cross(x_vector);
-                if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
-            }
-            proc->set_text_x(x_vector);
-            proc->set_text_y(y_vector);
-        }
-        else if (std::abs(x_vector.dot(_normal)) == 0 && std::abs(y_vector.dot(_normal)) != 0) {
-            Vector3D temp_vector = _normal.cross(x_vector);
-            if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
-            proc->set_text_y(y_vector);
-        }
-        else if (std::abs(y_vector.dot(_normal)) == 0 && std::abs(x_vector.dot(_normal)) != 0) {
-            Vector3D temp_vector = _normal.cross(y_vector);
-            if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
-            proc->set_text_x(x_vector);
-        }
-        never_checked = false;
-    }
 
     double x_value = (inters_point - _one_point).dot(x_vector);
     double y_value = (inters_point - _one_point).dot(y_vector);
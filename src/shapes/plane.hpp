@@ -8,6 +8,7 @@
  */
 
 #include "surface.hpp"
+#include "primitives.hpp"
 
 /**
  * \class Plane
@@ -35,15 +36,21 @@ public:
 	Plane(double absorp, double reflect, double transp, Texture* tex,
             Point3D one_point, Vector3D normal) :
 			Surface(absorp, reflect, transp, tex),
-			_one_point(one_point), _normal(normal.normalized()) {}
+			_one_point(one_point), _normal(normal.normalized())
+    {
+        _type = PLANE;
+        init_texture_frame();
+    }
 
-	bool is_intersected_by(const Launchable&) const ; ///< Returns whether this plane is intersected by a given launchable
-	Couple3D get_nearest_intersection_with_normal(const Launchable&) const ; ///< Returns the nearest intersection (point/normal) of the given launchable with this plane
-	bool redirect_photon( const Couple3D&, Photon& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this plane
+	PlanePrimitive get_primitive() const { PlanePrimitive primitive = { _one_point, _normal } ; return primitive ; } ///< Returns the geometry of this plane for the kernels of the Scene
+	bool intersect(const Launchable&, double t_max, Hit&) const ; ///< Finds in one pass the nearest intersection of the given launchable with this plane closer than t_max
+	bool redirect_photon( const Couple3D&, Photon&, Sampler& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this plane
 	std::pair<Ray, Ray> divide_ray( const Couple3D&, const Ray& ) const; ///< Returns the division (reflected/refracted) of an incoming ray at the couple position
 	Color get_color_at(const Point3D&) const; ///< Returns the color at this point of the plane
 
 private:
+	void init_texture_frame() ; ///< Fixes the frame of a procedural texture on the plane
+
 	Point3D _one_point ; ///< A point of the plane
 	Vector3D _normal ; ///< The normal of the plane
 };
@@ -0,0 +1,486 @@
+#ifndef PRIMITIVES_HPP_
+#define PRIMITIVES_HPP_
+
+/**
+ * \file primitives.hpp
+ * \brief Declaration of the intersection kernels of the basic shapes
+ * \author B.BORGOBELLO / T.FEIGLER
+ *
+ * Each primitive only holds the geometry of its shape, laid out so that
+ * the Scene keeps one contiguous array per type and calls the kernels
+ * without going through the vtable of Shape. The kernels only give the
+ * distance of the intersection : the shapes use them in their own
+ * intersect() and complete the Hit (point, normal) themselves. The
+ * intersections up to the t_min of the launchables are ignored.
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include "geometry.hpp"
+#include "launchables/launchable.hpp"
+#include "launchables/ray_packet.hpp"
+
+/**
+ * \struct SpherePrimitive
+ * \brief Geometry of a Sphere
+ *
+ * The distances where a launchable meets the sphere are the roots of
+ * t^2 + 2bt + c = 0, its direction being a unit vector. They are solved
+ * without cancellation : the discriminant comes from the distance of the
+ * center to the line instead of b^2 - c, and the smaller root in magnitude
+ * from the product of the roots c instead of a difference of close values
+ */
+struct SpherePrimitive
+{
+	Point3D center ; ///< Center of the sphere
+	double radius ; ///< Radius of the sphere
+
+	/**
+	 * \brief Finds the two distances where the line of a launchable meets the sphere
+	 * \param l : the launchable to test
+	 * \param t_near, t_far : set to the distances of the entry and of the exit, t_near <= t_far
+	 *
+	 * Returns false if the line misses the sphere. The distances are
+	 * negative behind the start : t_near < 0 < t_far when it is inside
+	 */
+	bool get_roots(const Launchable& l, double& t_near, double& t_far) const
+	{
+		const Vector3D& dir = l.get_direction() ;
+		Vector3D from_center = l.get_end_point() - center ;
+
+		double b = from_center.dot(dir) ;
+		double c = from_center.squaredNorm() - radius*radius ;
+		Vector3D to_line = from_center - b * dir ;
+		double discriminant = radius*radius - to_line.squaredNorm() ;
+		if (discriminant < 0) return false ;
+
+		double q = -(b + ((b < 0) ? -sqrt(discriminant) : sqrt(discriminant))) ;
+		if (q == 0) { t_near = t_far = 0 ; return true ; } // Grazing the sphere at the start
+		t_near = std::min(c / q, q) ;
+		t_far = std::max(c / q, q) ;
+		return true ;
+	}
+
+	/**
+	 * \brief Finds the distance of the nearest intersection in ]t_min, t_max[
+	 * \param l : the launchable to test
+	 * \param t_min : intersections up to this distance are ignored
+	 * \param t_max : intersections farther than this distance are ignored
+	 * \param distance : set to the distance of the intersection if there is one
+	 *
+	 * From outside, the nearest point is kept ; from inside, the exit point
+	 */
+	bool intersect(const Launchable& l, double t_min, double t_max, double& distance) const
+	{
+		double t_near, t_far ;
+		if (!get_roots(l, t_near, t_far)) return false ;
+
+		double d = (t_near > t_min) ? t_near : t_far ;
+		if (d <= t_min || d >= t_max) return false ;
+
+		distance = d ;
+		return true ;
+	}
+
+	/**
+	 * \brief Finds the distance of the nearest intersection beyond the t_min of the launchable and closer than t_max
+	 */
+	bool intersect(const Launchable& l, double t_max, double& distance) const
+	{
+		return intersect(l, l.get_t_min(), t_max, distance) ;
+	}
+
+	/**
+	 * \brief Returns whether the launchable meets the sphere closer than t_max
+	 *
+	 * Same test as intersect() for the occlusion queries, without keeping the distance
+	 */
+	bool is_intersected_by(const Launchable& l, double t_max) const
+	{
+		double distance ;
+		return intersect(l, l.get_t_min(), t_max, distance) ;
+	}
+
+	/**
+	 * \brief Same computation as intersect(), on the four lanes of a packet at once
+	 * \param packet : the launchables to test
+	 * \param lanes : the lanes to test, lane i as bit i
+	 * \param t_max : distance of each lane beyond which the sphere is ignored
+	 * \param distances : set to the distance of each lane to the sphere
+	 *
+	 * Returns the lanes meeting the sphere before their t_max, lane i as bit i
+	 */
+	int intersect_packet(const RayPacket& packet, int lanes, const Double4& t_max, double distances[]) const
+	{
+		Double4 from_center[3] ;
+		for (int i = 0; i < 3; i++) from_center[i] = packet.origin[i] - Double4(center[i]) ;
+
+		Double4 distance ;
+		Double4 valid = nearest_root(from_center, packet.direction, Double4(radius*radius), packet.t_min, t_max, distance) ;
+
+		distance.store(distances) ;
+		return valid.mask() & lanes ;
+	}
+
+	/**
+	 * \brief Solves on each lane the intersection of a line with a sphere as get_roots() and intersect() do,
+	 * for intersect_packet()
+	 * \param from_center : components of the start of each line, relative to the center of its sphere
+	 * \param dir : components of the unit direction of each line
+	 * \param radius_2 : squared radius of each sphere
+	 * \param t_min, t_max : the interval where intersections are kept
+	 * \param distance : set to the nearest root in the interval on each lane
+	 *
+	 * Returns the lanes having a root in the interval
+	 */
+	static Double4 nearest_root(const Double4 from_center[3], const Double4 dir[3], const Double4& radius_2,
+		const Double4& t_min, const Double4& t_max, Double4& distance)
+	{
+		Double4 zero(0.0) ;
+		Double4 b = dot(from_center[0], from_center[1], from_center[2], dir[0], dir[1], dir[2]) ;
+		Double4 c = dot(from_center[0], from_center[1], from_center[2], from_center[0], from_center[1], from_center[2]) - radius_2 ;
+		Double4 to_line[3] ;
+		for (int i = 0; i < 3; i++) to_line[i] = from_center[i] - b * dir[i] ;
+		Double4 discriminant = radius_2 - dot(to_line[0], to_line[1], to_line[2], to_line[0], to_line[1], to_line[2]) ;
+
+		Double4 root = sqrt( max(zero, discriminant) ) ;
+		Double4 q = zero - (b + select(b < zero, zero - root, root)) ;
+		Double4 other = select(abs(q) > zero, c / q, zero) ; // q is 0 only when grazing the sphere at the start
+		Double4 t_near = min(q, other), t_far = max(q, other) ;
+
+		distance = select(t_near > t_min, t_near, t_far) ;
+		return (discriminant >= zero) & (distance > t_min) & (distance < t_max) ;
+	}
+};
+
+/**
+ * \struct PlanePrimitive
+ * \brief Geometry of a Plane
+ */
+struct PlanePrimitive
+{
+	Point3D one_point ; ///< A point of the plane
+	Vector3D normal ; ///< The unit normal of the plane
+
+	/**
+	 * \brief Finds the distance of the intersection closer than t_max
+	 * \param l : the launchable to test
+	 * \param t_max : intersections farther than this distance are ignored
+	 * \param distance : set to the distance of the intersection if there is one
+	 */
+	bool intersect(const Launchable& l, double t_max, double& distance) const
+	{
+		static const double epsilon = 1e-7 ;
+		const Point3D& start = l.get_end_point() ;
+		const Vector3D& dir = l.get_direction() ;
+
+		double dir_dot_normal = dir.dot(normal) ;
+		if (std::abs(dir_dot_normal) < epsilon) return false ;
+
+		double start_height = normal.dot( start - one_point ) ;
+		double d = -start_height / dir_dot_normal ;
+		if (d <= l.get_t_min() || d >= t_max) return false ; // Going away from the plane, starting on it, or too far
+
+		distance = d ;
+		return true ;
+	}
+
+	/**
+	 * \brief Same computation as intersect(), on the four lanes of a packet at once
+	 * \param packet : the launchables to test
+	 * \param lanes : the lanes to test, lane i as bit i
+	 * \param t_max : distance of each lane beyond which the plane is ignored
+	 * \param distances : set to the distance of each lane to the plane
+	 *
+	 * Returns the lanes meeting the plane before their t_max, lane i as bit i
+	 */
+	int intersect_packet(const RayPacket& packet, int lanes, const Double4& t_max, double distances[]) const
+	{
+		static const double epsilon = 1e-7 ;
+		Double4 n[3] = { Double4(normal[0]), Double4(normal[1]), Double4(normal[2]) } ;
+
+		Double4 dir_dot_normal = dot(packet.direction[0], packet.direction[1], packet.direction[2],
+			n[0], n[1], n[2]) ;
+		Double4 start_height = dot(n[0], n[1], n[2],
+			packet.origin[0] - Double4(one_point[0]), packet.origin[1] - Double4(one_point[1]), packet.origin[2] - Double4(one_point[2])) ;
+		Double4 distance = (Double4(0.0) - start_height) / dir_dot_normal ;
+
+		Double4 valid = (abs(dir_dot_normal) >= Double4(epsilon)) & (distance > packet.t_min) ;
+		distance.store(distances) ;
+		return (valid & (distance < t_max)).mask() & lanes ;
+	}
+};
+
+/**
+ * \struct TrianglePrimitive
+ * \brief Geometry of a Triangle, with its edges and normal computed once
+ *
+ * Intersected with the Moller-Trumbore algorithm : the intersection is
+ * solved directly in the frame of the two edges from a, which gives its
+ * distance and its barycentric coordinates without any square root
+ */
+struct TrianglePrimitive
+{
+	/**
+	 * \brief Constructor
+	 * \param a, b, c : the three corners of the triangle
+	 */
+	TrianglePrimitive(const Point3D& a, const Point3D& b, const Point3D& c) :
+		a(a), e1(b - a), e2(c - a), normal(e1.cross(e2)), min_det2(1e-14 * normal.squaredNorm()) {}
+
+	Point3D a ; ///< First corner of the triangle
+	Vector3D e1, e2 ; ///< Edges from a to the two other corners
+	Vector3D normal ; ///< e1 x e2, not normalized (its norm is twice the area)
+	double min_det2 ; ///< Square of the smallest determinant kept, launchables closer to the plane are parallel to it
+
+	/**
+	 * \brief Finds the distance and the barycentric coordinates of the intersection closer than t_max
+	 * \param l : the launchable to test
+	 * \param t_max : intersections farther than this distance are ignored
+	 * \param distance : set to the distance of the intersection if there is one
+	 * \param u, v : set to the weights of the second and third corners at the intersection,
+	 * the first one being 1 - u - v
+	 */
+	bool intersect(const Launchable& l, double t_max, double& distance, double& u, double& v) const
+	{
+		const Point3D& start = l.get_end_point() ;
+		const Vector3D& dir = l.get_direction() ;
+
+		// det is -dir.normal : its square is compared to the squared norm of the normal
+		Vector3D p = dir.cross(e2) ;
+		double det = e1.dot(p) ;
+		if (det * det < min_det2) return false ;
+		double inv_det = 1.0 / det ;
+
+		Vector3D s = start - a ;
+		u = s.dot(p) * inv_det ;
+		if (u < 0 || u > 1) return false ;
+
+		Vector3D q = s.cross(e1) ;
+		v = dir.dot(q) * inv_det ;
+		if (v < 0 || u + v > 1) return false ;
+
+		double d = e2.dot(q) * inv_det ;
+		if (d <= l.get_t_min() || d >= t_max) return false ; // Behind the start, on it, or too far
+
+		distance = d ;
+		return true ;
+	}
+
+	/**
+	 * \brief Finds the distance of the intersection closer than t_max
+	 * \param l : the launchable to test
+	 * \param t_max : intersections farther than this distance are ignored
+	 * \param distance : set to the distance of the intersection if there is one
+	 */
+	bool intersect(const Launchable& l, double t_max, double& distance) const
+	{
+		double u, v ;
+		return intersect(l, t_max, distance, u, v) ;
+	}
+
+	/**
+	 * \brief Same computation as intersect(), on the four lanes of a packet at once
+	 * \param packet : the launchables to test
+	 * \param lanes : the lanes to test, lane i as bit i
+	 * \param t_max : distance of each lane beyond which the triangle is ignored
+	 * \param distances : set to the distance of each lane to the triangle
+	 *
+	 * Returns the lanes meeting the triangle before their t_max, lane i as bit i.
+	 * All the lanes go through the whole computation, without any branch
+	 */
+	int intersect_packet(const RayPacket& packet, int lanes, const Double4& t_max, double distances[]) const
+	{
+		Double4 edge1[3] = { Double4(e1[0]), Double4(e1[1]), Double4(e1[2]) } ;
+		Double4 edge2[3] = { Double4(e2[0]), Double4(e2[1]), Double4(e2[2]) } ;
+
+		Double4 p[3], s[3], q[3] ;
+		cross(packet.direction, edge2, p) ;
+		Double4 det = dot(edge1[0], edge1[1], edge1[2], p[0], p[1], p[2]) ;
+		Double4 inv_det = Double4(1.0) / det ;
+
+		for (int i = 0; i < 3; i++) s[i] = packet.origin[i] - Double4(a[i]) ;
+		Double4 u = dot(s[0], s[1], s[2], p[0], p[1], p[2]) * inv_det ;
+		cross(s, edge1, q) ;
+		Double4 v = dot(packet.direction[0], packet.direction[1], packet.direction[2], q[0], q[1], q[2]) * inv_det ;
+		Double4 distance = dot(edge2[0], edge2[1], edge2[2], q[0], q[1], q[2]) * inv_det ;
+
+		Double4 zero(0.0), one(1.0) ;
+		Double4 valid = (det * det >= Double4(min_det2)) & (u >= zero) & (u <= one)
+			& (v >= zero) & (u + v <= one) & (distance > packet.t_min) & (distance < t_max) ;
+
+		distance.store(distances) ;
+		return valid.mask() & lanes ;
+	}
+
+private:
+	/**
+	 * \brief Sets r to x cross y on each lane, in the same order as Eigen's cross product
+	 */
+	static void cross(const Double4 x[3], const Double4 y[3], Double4 r[3])
+	{
+		r[0] = x[1] * y[2] - x[2] * y[1] ;
+		r[1] = x[2] * y[0] - x[0] * y[2] ;
+		r[2] = x[0] * y[1] - x[1] * y[0] ;
+	}
+};
+
+/**
+ * \struct ParallelepipedPrimitive
+ * \brief Geometry of a Parallelepiped, as an oriented frame with its inverse
+ *
+ * In the frame of the corner and the three edges, the volume is the unit
+ * cube : the launchables are brought in this frame and clipped by the
+ * three slabs 0 <= coordinate <= 1 (slab test). The distances along the
+ * launchable are the same in both frames since the change is affine
+ */
+struct ParallelepipedPrimitive
+{
+	/**
+	 * \brief Constructor
+	 * \param corner : one corner of the volume
+	 * \param x, y, z : the three edges starting from this corner
+	 */
+	ParallelepipedPrimitive(const Point3D& corner, const Vector3D& x, const Vector3D& y, const Vector3D& z) :
+		corner(corner)
+	{
+		static const double epsilon = 1e-7 ;
+
+		// Rows of the inverse of the matrix of columns x, y, z
+		double volume = x.dot(y.cross(z)) ;
+		to_local[0] = y.cross(z) / volume ;
+		to_local[1] = z.cross(x) / volume ;
+		to_local[2] = x.cross(y) / volume ;
+		for (int i = 0; i < 3; i++) {
+			double norm = to_local[i].norm() ;
+			normals[i] = to_local[i] / norm ;
+			min_slope[i] = epsilon * norm ;
+		}
+	}
+
+	Point3D corner ; ///< Origin of the frame
+	Vector3D to_local[3] ; ///< Coordinate i of a point p in the frame is to_local[i].(p - corner)
+	Vector3D normals[3] ; ///< Unit normal of the sides across axis i, pointing to increasing coordinates
+	double min_slope[3] ; ///< Smallest |to_local[i].direction| kept, launchables more parallel to the sides never cross them
+
+	/**
+	 * \brief Clips a launchable by the three slabs
+	 * \param l : the launchable to clip
+	 * \param t_entry, t_exit : set to the distances where the launchable enters and leaves the volume
+	 * \param entry_axis, exit_axis : set to the axis of the sides crossed there
+	 *
+	 * Returns false if the line of the launchable misses the volume. The
+	 * distances are negative behind the start : t_entry < 0 < t_exit when
+	 * the launchable starts inside
+	 */
+	bool get_entry_exit(const Launchable& l, double& t_entry, int& entry_axis, double& t_exit, int& exit_axis) const
+	{
+		Vector3D from_corner = l.get_end_point() - corner ;
+		const Vector3D& dir = l.get_direction() ;
+
+		t_entry = -DBL_MAX ;
+		t_exit = DBL_MAX ;
+		entry_axis = exit_axis = -1 ;
+		for (int i = 0; i < 3; i++) {
+			double start = to_local[i].dot(from_corner) ;
+			double slope = to_local[i].dot(dir) ;
+			if (std::abs(slope) < min_slope[i]) { // Parallel to this slab : the whole line is in it or out of it
+				if (start < 0 || start > 1) return false ;
+				continue ;
+			}
+
+			double inv_slope = 1.0 / slope ;
+			double t_low = -start * inv_slope, t_high = (1 - start) * inv_slope ;
+			if (t_low > t_high) std::swap(t_low, t_high) ;
+			if (t_low > t_entry) { t_entry = t_low ; entry_axis = i ; }
+			if (t_high < t_exit) { t_exit = t_high ; exit_axis = i ; }
+		}
+		return entry_axis >= 0 && t_entry <= t_exit ;
+	}
+
+	/**
+	 * \brief Finds the side met closer than t_max
+	 * \param l : the launchable to test
+	 * \param t_max : intersections farther than this distance are ignored
+	 * \param distance : set to the distance of the intersection if there is one
+	 *
+	 * From outside the volume, the side met is the one of the entry,
+	 * from inside the one of the exit. Returns the axis of this side, -1 if none
+	 */
+	int intersect_axis(const Launchable& l, double t_max, double& distance) const
+	{
+		double t_entry, t_exit ;
+		int entry_axis, exit_axis ;
+		if (!get_entry_exit(l, t_entry, entry_axis, t_exit, exit_axis)) return -1 ;
+
+		double t_min = l.get_t_min() ;
+		if (t_entry > t_min) {
+			if (t_entry >= t_max) return -1 ;
+			distance = t_entry ;
+			return entry_axis ;
+		}
+		if (t_exit <= t_min || t_exit >= t_max) return -1 ;
+		distance = t_exit ;
+		return exit_axis ;
+	}
+
+	/**
+	 * \brief Finds the distance of the nearest intersection closer than t_max
+	 */
+	bool intersect(const Launchable& l, double t_max, double& distance) const
+	{
+		return intersect_axis(l, t_max, distance) >= 0 ;
+	}
+
+	/**
+	 * \brief Returns the normal of a side across the given axis facing the start of a launchable meeting it
+	 *
+	 * Entering or leaving, a launchable meets the side across which
+	 * it goes along this axis : the normal is opposite to its direction
+	 */
+	Vector3D get_facing_normal(int axis, const Vector3D& dir) const
+	{
+		return (to_local[axis].dot(dir) > 0) ? Vector3D(-normals[axis]) : normals[axis] ;
+	}
+
+	/**
+	 * \brief Same computation as intersect(), on the four lanes of a packet at once
+	 * \param packet : the launchables to test
+	 * \param lanes : the lanes to test, lane i as bit i
+	 * \param t_max : distance of each lane beyond which the volume is ignored
+	 * \param distances : set to the distance of each lane to the volume
+	 *
+	 * Returns the lanes meeting the volume before their t_max, lane i as bit i
+	 */
+	int intersect_packet(const RayPacket& packet, int lanes, const Double4& t_max, double distances[]) const
+	{
+		Double4 zero(0.0), one(1.0) ;
+		Double4 t_entry(-DBL_MAX), t_exit(DBL_MAX) ;
+		int missed = 0 ;
+
+		for (int i = 0; i < 3; i++) {
+			Double4 axis[3] = { Double4(to_local[i][0]), Double4(to_local[i][1]), Double4(to_local[i][2]) } ;
+			Double4 start = dot(axis[0], axis[1], axis[2], packet.origin[0] - Double4(corner[0]),
+				packet.origin[1] - Double4(corner[1]), packet.origin[2] - Double4(corner[2])) ;
+			Double4 slope = dot(packet.direction[0], packet.direction[1], packet.direction[2], axis[0], axis[1], axis[2]) ;
+
+			// The lanes parallel to this slab keep their interval if they are in it
+			Double4 parallel = abs(slope) < Double4(min_slope[i]) ;
+			missed |= (parallel & ((start < zero) | (start > one))).mask() ;
+
+			Double4 inv_slope = one / slope ;
+			Double4 t_low = (zero - start) * inv_slope, t_high = (one - start) * inv_slope ;
+			t_entry = select(parallel, t_entry, max(t_entry, min(t_low, t_high))) ;
+			t_exit = select(parallel, t_exit, min(t_exit, max(t_low, t_high))) ;
+		}
+
+		Double4 distance = select(t_entry > packet.t_min, t_entry, t_exit) ;
+		Double4 valid = (t_entry <= t_exit) & (distance > packet.t_min) & (distance < t_max) ;
+
+		distance.store(distances) ;
+		return valid.mask() & ~missed & lanes ;
+	}
+};
+
+#endif /* PRIMITIVES_HPP_ */
@@ -11,6 +11,10 @@
 #include "textures/texture.hpp"
 #include "launchables/photon.hpp"
 #include "launchables/ray.hpp"
+#include "launchables/ray_packet.hpp"
+#include "bounding_box.hpp"
+#include "hit.hpp"
+#include "sampler.hpp"
 
 /**
  * \class Shape
@@ -21,6 +25,13 @@
 class Shape
 {
 public:
+	/**
+	 * \brief Type of the shape, for the Scene to dispatch its intersection kernel without virtual calls
+	 *
+	 * OTHER is for the shapes having no kernel, only tested through intersect()
+	 */
+	enum Type { SPHERE, PLANE, TRIANGLE, PARALLELEPIPED, OTHER } ;
+
     /**
 	 * \brief Constructor
 	 *
@@ -31,20 +42,68 @@ public:
 	 * \param tex : pointer to the texture of this Shape
 	 */
 	Shape(double absorp, double reflect, Texture* tex) :
-		_absorption_prob(absorp), _reflection_prob(reflect),
+		_type(OTHER), _absorption_prob(absorp), _reflection_prob(reflect),
 		_texture( boost::shared_ptr< Texture >(tex) ) {}
 
+	Type get_type() const { return _type ; } ///< Returns the type of this shape
+
 	boost::shared_ptr<Texture> get_texture() const { return _texture ; } ///< Returns a smart pointer to the texture used by this shape
 	double get_absorption_prob() const { return _absorption_prob ; } ///< Returns the absorption probability of this shape
 	double get_reflection_prob() const { return _reflection_prob ; } ///< Returns the reflection probability of this shape
 
-	virtual bool is_intersected_by(const Launchable&) const = 0 ; ///< Returns whether this Shape is intersected by a given launchable
-	virtual Couple3D get_nearest_intersection_with_normal( const Launchable& ) const = 0 ; ///< Returns the nearest intersection (point/normal) of the given launchable with this shape
-	virtual bool redirect_photon( const Couple3D&, Photon& ) const = 0 ; ///< Redirects (or not) a given photon depending on the probilities of this shape
+	virtual bool intersect(const Launchable&, double t_max, Hit&) const = 0 ; ///< Finds in one pass the nearest intersection (distance/point/normal) of the given launchable closer than t_max, returns whether there is one
+	virtual bool is_intersected_by(const Launchable& l, double t_max) const { Hit hit ; return intersect(l, t_max, hit) ; } ///< Returns whether the given launchable meets this shape closer than t_max, for the occlusion queries which need no Hit
+	virtual bool redirect_photon( const Couple3D&, Photon&, Sampler& ) const = 0 ; ///< Redirects (or not) a given photon depending on the probilities of this shape, drawing from the sampler of the photon
 	virtual std::pair<Ray, Ray> divide_ray( const Couple3D&, const Ray& ) const = 0 ; ///< Returns the division (reflected/refracted) of an incoming ray at the couple position
 	virtual Color get_color_at(const Point3D&) const = 0; ///< Returns the color at this point of the shape
+	virtual bool get_bounding_box(BoundingBox&) const { return false ; } ///< Fills the box enclosing this shape, returns false if the shape is unbounded
+
+	/**
+	 * \brief Finds the nearest distance of the given lanes of a packet to this shape
+	 * \param packet : the launchables to test
+	 * \param lanes : the lanes to test, lane i as bit i
+	 * \param t_max : distance of each lane, lowered where this shape is met closer
+	 * \param hit_shapes : set to this shape where it is met closer
+	 *
+	 * Tests the launchables one at a time. The Scene only calls it for the shapes of
+	 * type OTHER, the other types having their SIMD kernel in primitives.hpp
+	 */
+	virtual void intersect_packet(const RayPacket& packet, int lanes, Double4& t_max, const Shape* hit_shapes[]) const
+	{
+		double t[RayPacket::SIZE], distance[RayPacket::SIZE] ;
+		t_max.store(t) ;
+		int found = 0 ;
+		Hit hit ;
+		for (int i = 0; i < RayPacket::SIZE; i++)
+			if (((lanes >> i) & 1) && intersect(packet.get_launchable(i), t[i], hit)) {
+				distance[i] = hit.distance ;
+				found |= 1 << i ;
+			}
+		keep_packet_hits(found, distance, t_max, hit_shapes) ;
+	}
 
 protected:
+	/**
+	 * \brief Records this shape on the lanes of a packet where it is the nearest so far
+	 * \param found : the lanes where this shape is met before their t_max, lane i as bit i
+	 * \param distance : the distance of each lane to this shape
+	 * \param t_max : lowered to distance on the found lanes
+	 * \param hit_shapes : set to this shape on the found lanes
+	 */
+	void keep_packet_hits(int found, const double distance[], Double4& t_max, const Shape* hit_shapes[]) const
+	{
+		if (found == 0) return ;
+		double t[RayPacket::SIZE] ;
+		t_max.store(t) ;
+		for (int i = 0; i < RayPacket::SIZE; i++)
+			if ((found >> i) & 1) {
+				t[i] = distance[i] ;
+				hit_shapes[i] = this ;
+			}
+		t_max = Double4(t[0], t[1], t[2], t[3]) ;
+	}
+
+	Type _type ; ///< Type of this shape, set by the constructors of the shapes having a kernel
 	double _absorption_prob; ///< Absorption probabilities
 	double _reflection_prob ; ///< Reflection probabilities
 	boost::shared_ptr<Texture> _texture ; ///< A smart pointer to the texture used by this Shape
@@ -4,6 +4,7 @@
  * \author B.BORGOBELLO / T.FEIGLER
  */
 
+#include <algorithm>
 #include <cmath>
 #include <cstdlib>
 #include <time.h>
@@ -16,101 +17,84 @@
 /**
  * \param l : the incoming launchable to test
  * collision with
+ * \param t_max : intersections farther than this distance are ignored
+ * \param hit : filled with the intersection if one is found
  *
  * This function returns whether the launchable direction
- * will lead to a collision with this sphere
- */
-bool Sphere::is_intersected_by(const Launchable& l) const
-{
-	Point3D start = l.get_end_point() ;
-	Vector3D dir = l.get_direction() ;
+ * will lead to a collision with this sphere before t_max.
+ * From outside, the nearest point is kept with an outward normal ;
+ * from inside, the exit point is kept with an inward normal. The
+ * normal is oriented by the direction, so that a launchable starting
+ * from the surface gets it right whatever the rounding of its start
+ */
+bool Sphere::intersect(const Launchable& l, double t_max, Hit& hit) const
+{
+	double distance ;
+	if (!get_primitive().intersect(l, t_max, distance)) return false;
+
+	const Point3D& start = l.get_end_point() ;
+	const Vector3D& dir = l.get_direction() ;
+
+	Point3D nearest = start + distance * dir ;
+	Vector3D normal = (nearest - _center).normalized() ;
+
+	hit.distance = distance ;
+	hit.couple = Couple3D( nearest, (normal.dot(dir) > 0) ? Vector3D(-normal) : normal ) ;
+	hit.shape = this ;
+	return true ;
+}
 
-	if ((start-_center).squaredNorm() < _radius*_radius) return true; // Already inside the sphere
-
-	Point3D center_proj = dir * dir.dot( _center - start ) + start ;
-
-	return ( ((_center - center_proj).squaredNorm() <= _radius*_radius )
-				&& (center_proj - start).dot(dir) > 0 ) ;
-}
-
 /**
- * \param l : the incoming launchable to find
- * intersection with
+ * \param l : the launchable to test
+ * \param t_max : intersections farther than this distance are ignored
  *
- * This function returns a couple containing the nearest
- * intersection point (first param) with this Sphere and
- * the normal at intersection point (second param)
- */
-Couple3D Sphere::get_nearest_intersection_with_normal(const Launchable& l) const
-{
-	Point3D start = l.get_end_point() ;
-	Vector3D dir = l.get_direction() ;
-	Vector3D normal;
-
-	Point3D center_proj = dir * dir.dot( _center - start ) + start ;
-
-	double r1_pow2 = ( _center - center_proj ).squaredNorm() ;
-	double r2 = sqrt( _radius*_radius - r1_pow2 ) ;
-
-	Point3D M1, M2, nearest ;
-	M1 = center_proj + r2 * dir ;
-	M2 = center_proj - r2 * dir ;
-
-    if ((start-_center).squaredNorm() < _radius*_radius) { // Inside the sphere
-        //std::cout << "INSIIIIDE THE SPHERE\n\n";
-        //std::cout << "Intersections found\n" << M1 << std::endl << M2 << std::endl;
-        if (dir.dot(M1-center_proj) > 0) nearest = M1;
-        else nearest = M2;
-        normal = -(nearest - _center).normalized();
-    }
-    else {
-        if( (M1 - start).squaredNorm() > (M2 - start).squaredNorm())
-            nearest = M2 ;
-        else
-            nearest = M1 ;
-        normal = (nearest - _center).normalized();
-    }
-
-	return Couple3D( nearest, normal ) ;
+ * Same test as intersect(), for the occlusion queries : neither
+ * the intersection point nor its normal are computed
+ */
+bool Sphere::is_intersected_by(const Launchable& l, double t_max) const
+{
+	return get_primitive().is_intersected_by(l, t_max) ;
 }
-
+
 /**
+ * \param sampler : the random generator of the emitted photon
+ *
  * Returns a couple containing as first parameter
  * a random point of the surface of the sphere from
  * where to emit, and a corresponding normal as second
  * parameter
  */
-Couple3D Sphere::get_random_point_and_normal() const
+Couple3D Sphere::get_random_point_and_normal(Sampler& sampler) const
 {
-	/*
-	 * TODO : mettre en place ici l'utilisation du générateur aléatoire
-	 * parallèle [ CF trng.berlios.de ]
-	*/
-	Vector3D position_from_center ;
-	do
-	{
-		position_from_center << ( rand() / (double)RAND_MAX ) - 0.5,
-							( rand() / (double)RAND_MAX ) - 0.5,
-							( rand() / (double)RAND_MAX ) - 0.5 ;
-	}
-	while( position_from_center.squaredNorm() > 1 ) ;
-	position_from_center.normalize() ;
-	Point3D position = _center + _radius*position_from_center ;
+	Couple3D surface = get_random_surface_point(sampler) ;
 
 	Vector3D direction ;
 	do
 	{
-		direction << 	( rand() / (double)RAND_MAX ) - 0.5,
-						( rand() / (double)RAND_MAX ) - 0.5,
-						( rand() / (double)RAND_MAX ) - 0.5 ;
+		direction = sampler.next_unit_vector() ;
 	}
-	while( direction.dot(position_from_center) < 0 ) ;
+	while( direction.dot(surface.second) < 0 ) ;
+
+	return Couple3D( surface.first, direction ) ;
+}
+
+/**
+ * \param sampler : the random generator to draw from
+ *
+ * Returns a couple containing as first parameter a random point
+ * of the surface of the sphere, drawn as the emission points of
+ * the photons, and the outward normal at this point as second parameter
+ */
+Couple3D Sphere::get_random_surface_point(Sampler& sampler) const
+{
+	Vector3D position_from_center = sampler.next_unit_vector() ;
 
-	return Couple3D( position, direction ) ;
+	return Couple3D( _center + _radius*position_from_center, position_from_center ) ;
 }
 
 /**
  * \param ph : the incoming photon to redirect
+ * \param sampler : the random generator of the photon
  * \param couple : first parameter contains
  * the intersection point, second contains the normal
  * at this intersection
@@ -121,19 +105,18 @@ Couple3D Sphere::get_random_point_and_normal() const
  * It returns TRUE is the photon was redirected, and
  * FALSE if the photon was absorbed.
  */
-bool Sphere::redirect_photon( const Couple3D& couple, Photon& ph ) const
+bool Sphere::redirect_photon( const Couple3D& couple, Photon& ph, Sampler& sampler ) const
 {
 	//using namespace std;
 	Point3D intersection_point = couple.first;
 	Vector3D intersection_normal = couple.second;
 
-    double number = (double)rand()/RAND_MAX;
-    static double epsilon = 1e-6;
+    double number = sampler.next_double();
 
     if (number < _reflection_prob) {
         ph.set_end_point(intersection_point);
         ph.set_direction(ph.get_reflected(couple));
-        ph.set_end_point(ph.get_end_point() + ph.get_direction()*epsilon);
+        ph.leave_surface();
         //cout << "Getting reflected" << endl;
 
         Color ph_c = ph.get_color() ;
@@ -151,7 +134,7 @@ bool Sphere::redirect_photon( const Couple3D& couple, Photon& ph ) const
         //std::cout << ((ratio <= 1) ? "Entering surface\n" : "Getting out\n");
         ph.set_end_point(intersection_point);
         ph.set_direction(ph.get_refracted(couple, ratio));
-        ph.set_end_point(ph.get_end_point() + ph.get_direction()*epsilon);
+        ph.leave_surface();
         //cout << "Getting refracted" << endl;
 
         Color ph_c = ph.get_color() ;
@@ -185,7 +168,6 @@ std::pair<Ray, Ray> Sphere::divide_ray( const Couple3D& couple, const Ray& ray)
 {
     Point3D intersection_point = couple.first;
 	Vector3D intersection_normal = couple.second;
-	static double epsilon = 1e-6;
 
     Ray reflected_ray(Point3D(0,0,0), Vector3D(0,0,0));
     Ray refracted_ray(Point3D(0,0,0), Vector3D(0,0,0));
@@ -194,7 +176,7 @@ std::pair<Ray, Ray> Sphere::divide_ray( const Couple3D& couple, const Ray& ray)
         reflected_ray = Ray(Point3D(0,0,0), Vector3D(0,0,0));
     else {
         reflected_ray = Ray(intersection_point, ray.get_reflected(couple));
-        reflected_ray.set_end_point(reflected_ray.get_end_point() + reflected_ray.get_direction()*epsilon);
+        reflected_ray.leave_surface();
     }
 
     if (_refraction_prob == 0)
@@ -203,7 +185,7 @@ std::pair<Ray, Ray> Sphere::divide_ray( const Couple3D& couple, const Ray& ray)
         double ratio = (intersection_normal.dot((intersection_point - _center).normalized()) > 0) ? 1.0/_ref_index : _ref_index;
         //std::cout << ((ratio <= 1) ? "Entering surface\n" : "Getting out\n");
         refracted_ray = Ray(intersection_point, ray.get_refracted(couple, ratio));
-        refracted_ray.set_end_point(refracted_ray.get_end_point() + refracted_ray.get_direction()*epsilon);
+        refracted_ray.leave_surface();
         if (refracted_ray.get_direction()[0] == reflected_ray.get_direction()[0]
             && refracted_ray.get_direction()[1] == reflected_ray.get_direction()[1]
              && refracted_ray.get_direction()[2] == reflected_ray.get_direction()[2])
@@ -215,17 +197,16 @@ std::pair<Ray, Ray> Sphere::divide_ray( const Couple3D& couple, const Ray& ray)
 }
 
 /**
- * \param inters_point : an intersection point where we seek the color
- *
- * This function determines the color at the given point of the surface
- * It is related to the get_color(double, double) of the Texture where the
- * two doubles represent coordinates for the texture map.
+ * Fixes once for all the texture frame (text_x/text_y) of a procedural
+ * texture so that it lies on the sphere, choosing random
+ * vectors when the scene file gave none. Called by the constructor
+ * so that rendering only reads the frame, from any thread.
  */
-Color Sphere::get_color_at(const Point3D& inters_point) const
+void Sphere::init_texture_frame()
 {
-    if (dynamic_cast<Colored*>(_texture.get())) return _texture->get_color(0,0);
-
     Procedural * proc = dynamic_cast<Procedural *>(_texture.get());
+    if (proc == NULL) return;
+
     Vector3D x_vector = proc->get_text_x();
     Vector3D y_vector = proc->get_text_y();
 
@@ -252,6 +233,22 @@ Color Sphere::get_color_at(const Point3D& inters_point) const
         x_vector = y_vector.cross(x_vector).normalized();
         proc->set_text_y(x_vector);
     }
+}
+
+/**
+ * \param inters_point : an intersection point where we seek the color
+ *
+ * This function determines the color at the given point of the surface
+ * It is related to the get_color(double, double) of the Texture where the
+ * two doubles represent coordinates for the texture map.
+ */
+Color Sphere::get_color_at(const Point3D& inters_point) const
+{
+    if (_texture->get_kind() == Texture::COLORED) return _texture->get_color(0,0);
+
+    Procedural * proc = static_cast<Procedural *>(_texture.get());
+    Vector3D x_vector = proc->get_text_x();
+    Vector3D y_vector = proc->get_text_y();
 
     Vector3D current_vector = (inters_point-_center).normalized();
     if (std::abs(y_vector.dot(current_vector)) == 1) return _texture->get_color(0, 0);
@@ -265,3 +262,15 @@ Color Sphere::get_color_at(const Point3D& inters_point) const
 
     return _texture->get_color(x_value, y_value);
 }
+
+/**
+ * \param box : filled with the box enclosing the sphere
+ *
+ * Spheres are always bounded
+ */
+bool Sphere::get_bounding_box(BoundingBox& box) const
+{
+    Vector3D radius = Vector3D::Constant(_radius);
+    box = BoundingBox(_center - radius, _center + radius);
+    return true;
+}
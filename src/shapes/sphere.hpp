@@ -9,6 +9,7 @@
  */
 
 #include "volume.hpp"
+#include "primitives.hpp"
 
 /**
  * \class Sphere
@@ -37,16 +38,25 @@ public:
 	Sphere(double absorp, double reflect, double refract, double index,
 		Texture* tex, Point3D center, double radius) :
 			Volume(absorp, reflect, refract, index, tex),
-			_center(center), _radius(radius) {}
+			_center(center), _radius(radius)
+    {
+        _type = SPHERE;
+        init_texture_frame();
+    }
 
-	bool is_intersected_by(const Launchable&) const ;  ///< Returns whether this sphere is intersected by a given launchable
-	Couple3D get_nearest_intersection_with_normal(const Launchable&) const ; ///< Returns the nearest intersection (point/normal) of the given launchable with this sphere
-	bool redirect_photon( const Couple3D&, Photon& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this sphere
+	SpherePrimitive get_primitive() const { SpherePrimitive primitive = { _center, _radius } ; return primitive ; } ///< Returns the geometry of this sphere for the kernels of the Scene
+	bool intersect(const Launchable&, double t_max, Hit&) const ; ///< Finds in one pass the nearest intersection of the given launchable with this sphere closer than t_max
+	bool is_intersected_by(const Launchable&, double t_max) const ; ///< Returns whether the given launchable meets this sphere closer than t_max, without computing the hit
+	bool redirect_photon( const Couple3D&, Photon&, Sampler& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this sphere
 	std::pair<Ray, Ray> divide_ray( const Couple3D&, const Ray& ) const; ///< Returns the division (reflected/refracted) of an incoming ray at the couple position
-	Couple3D get_random_point_and_normal() const ; ///< Returns a random surface point and a random normal of the sphere
+	Couple3D get_random_point_and_normal(Sampler&) const ; ///< Returns a random surface point and a random normal of the sphere
+	Couple3D get_random_surface_point(Sampler&) const ; ///< Returns a random surface point of the sphere and the outward normal at this point
 	Color get_color_at(const Point3D&) const; ///< Returns the color at this point of the sphere
+	bool get_bounding_box(BoundingBox&) const ; ///< Fills the box enclosing this sphere
 
 private:
+	void init_texture_frame() ; ///< Fixes the frame of a procedural texture on the sphere
+
 	Point3D _center ; ///< The center of the sphere in space
 	double _radius ; ///< The radius of the sphere
 };
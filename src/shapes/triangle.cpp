@@ -8,7 +8,6 @@
 #include <cstdlib>
 #include <time.h>
 #include "triangle.hpp"
-#include "plane.hpp"
 #include <textures/colored.hpp>
 #include <textures/procedural.hpp>
 #include <Eigen/Array>
@@ -16,64 +15,29 @@
 /**
  * \param l : the incoming launchable to test
  * the collision with
+ * \param t_max : intersections farther than this distance are ignored
+ * \param hit : filled with the intersection if one is found
  *
  * This function returns whether the launchable direction
- * will lead to a collision with this triangle
+ * will lead to a collision with this triangle before t_max.
+ * The normal given in the hit faces the start of the launchable
  */
-bool Triangle::is_intersected_by(const Launchable& l) const
+bool Triangle::intersect(const Launchable& l, double t_max, Hit& hit) const
 {
-    static double epsilon = 1e-7;
-	Point3D start = l.get_end_point() ;
-	Vector3D dir = l.get_direction() ;
-	Vector3D ab = _b-_a;
-	Vector3D ac = _c-_a;
-	Vector3D plane_normal = (ab).cross(ac).normalized();
-
-    if (std::abs(dir.dot(plane_normal)) < epsilon) return false;
-
-    Plane plane(0,0,0,NULL, _a, plane_normal);
-    if (!plane.is_intersected_by(l)) return false;
-    Point3D intersection = plane.get_nearest_intersection_with_normal(l).first;
-
-    Vector3D ac_dir = (_c-_a).normalized();
-    Vector3D ac_proj_ofm = ac_dir.dot(intersection-_a)*ac_dir;
-    Vector3D ac_perp = (intersection-_a) - ac_proj_ofm;
-    if (ac_perp.dot((_b-_a).normalized()) < 0) return false;
+    double distance;
+    if (!_primitive.intersect(l, t_max, distance)) return false;
 
-    Vector3D ab_dir = (_b-_a).normalized();
-    Vector3D ab_proj_ofm = ab_dir.dot(intersection-_a)*ab_dir;
-    Vector3D ab_perp = (intersection-_a) - ab_proj_ofm;
-    if (ab_perp.dot((_c-_a).normalized()) < 0) return false;
-
-    Vector3D bc_dir = (_c-_b).normalized();
-    Vector3D bc_proj_ofm = bc_dir.dot(intersection-_b)*bc_dir;
-    Vector3D bc_perp = (intersection-_b) - bc_proj_ofm;
-    if (bc_perp.dot((_a-_b).normalized()) < 0) return false;
+	const Vector3D& dir = l.get_direction() ;
 
+    hit.distance = distance;
+    hit.couple = Couple3D(l.get_end_point() + distance * dir, (_normal.dot(dir) < 0) ? _normal : Vector3D(-_normal));
+    hit.shape = this;
 	return true;
 }
 
-/**
- * \param l : the incoming launchable to find
- * intersection with
- *
- * This function returns a couple containing the nearest
- * intersection point (first param) with this triangle and
- * the normal at intersection point (second param)
- */
-Couple3D Triangle::get_nearest_intersection_with_normal(const Launchable& l) const
-{
-	Point3D start = l.get_end_point() ;
-	Vector3D dir = l.get_direction() ;
-	Vector3D ab = _a-_b;
-	Vector3D ac = _a-_c;
-	Vector3D plane_normal = (ab).cross(ac).normalized();
-
-	return  Plane(0,0,0,NULL, _a, plane_normal).get_nearest_intersection_with_normal(l);
-}
-
 /**
  * \param ph : the incoming photon to redirect
+ * \param sampler : the random generator of the photon
  * \param couple : first parameter contains
  * the intersection point, second contains the normal
  * at this intersection
@@ -84,16 +48,15 @@ Couple3D Triangle::get_nearest_intersection_with_normal(const Launchable& l) con
  * It returns TRUE is the photon was redirected, and
  * FALSE if the photon was absorbed
  */
-bool Triangle::redirect_photon( const Couple3D& couple, Photon& ph ) const
+bool Triangle::redirect_photon( const Couple3D& couple, Photon& ph, Sampler& sampler ) const
 {
     //using namespace std;
-    double number = (double)rand()/RAND_MAX;
-    static double epsilon = 1e-6;
+    double number = sampler.next_double();
 
     if (number < _reflection_prob) {
         ph.set_end_point(couple.first);
         ph.set_direction(ph.get_reflected(couple));
-        ph.set_end_point(ph.get_end_point() + ph.get_direction()*epsilon);
+        ph.leave_surface();
 
         Color ph_c = ph.get_color() ;
         Color shape_c = get_color_at(couple.first);
@@ -109,7 +72,7 @@ bool Triangle::redirect_photon( const Couple3D& couple, Photon& ph ) const
     else if (number < _reflection_prob + _transparency_prob) {
         ph.set_end_point(couple.first);
         ph.set_direction(ph.get_refracted(couple, 1.0));
-        ph.set_end_point(ph.get_end_point() + ph.get_direction()*epsilon);
+        ph.leave_surface();
 
         Color ph_c = ph.get_color() ;
         Color shape_c = get_color_at(couple.first);
@@ -140,7 +103,6 @@ bool Triangle::redirect_photon( const Couple3D& couple, Photon& ph ) const
 std::pair<Ray, Ray> Triangle::divide_ray( const Couple3D& couple, const Ray& ray) const {
     Point3D intersection_point = couple.first;
 	Vector3D intersection_normal = couple.second;
-	static double epsilon = 1e-7;
 
     Ray reflected_ray(Point3D(0,0,0), Vector3D(0,0,0));
     Ray refracted_ray(Point3D(0,0,0), Vector3D(0,0,0));
@@ -149,7 +111,7 @@ std::pair<Ray, Ray> Triangle::divide_ray( const Couple3D& couple, const Ray& ray
         reflected_ray = Ray(Point3D(0,0,0), Vector3D(0,0,0));
     else {
         reflected_ray = Ray(intersection_point, ray.get_reflected(couple));
-        reflected_ray.set_end_point(reflected_ray.get_end_point() + reflected_ray.get_direction()*epsilon);
+        reflected_ray.leave_surface();
     }
 
     if (_transparency_prob == 0)
@@ -157,7 +119,7 @@ std::pair<Ray, Ray> Triangle::divide_ray( const Couple3D& couple, const Ray& ray
     else {
         //std::cout << ((ratio <= 1) ? "Entering surface\n" : "Getting out\n");
         refracted_ray = Ray(intersection_point, ray.get_refracted(couple, 1.0));
-        refracted_ray.set_end_point(refracted_ray.get_end_point() + refracted_ray.get_direction()*epsilon);
+        refracted_ray.leave_surface();
         //cout << "Getting refracted" << endl;
     }
 
@@ -166,72 +128,98 @@ std::pair<Ray, Ray> Triangle::divide_ray( const Couple3D& couple, const Ray& ray
 
 
 /**
- * \param inters_point : an intersection point where we seek the color
- *
- * This function determines the color at the given point of the surface
- * It is related to the get_color(double, double) of the Texture where the
- * two doubles represent coordinates for the texture map.
+ * Fixes once for all the texture frame (text_x/text_y) of a procedural
+ * texture so that it lies on the plane of the triangle, choosing random
+ * vectors when the scene file gave none. Called by the constructor
+ * so that rendering only reads the frame, from any thread.
  */
-Color Triangle::get_color_at(const Point3D& inters_point) const
+void Triangle::init_texture_frame()
 {
-    if (dynamic_cast<Colored*>(_texture.get())) return _texture->get_color(0,0);
-
     Procedural * proc = dynamic_cast<Procedural *>(_texture.get());
+    if (proc == NULL) return;
+
+    Vector3D normal = (_a-_b).cross(_a-_c).normalized();
     Vector3D x_vector = proc->get_text_x();
     Vector3D y_vector = proc->get_text_y();
-    Vector3D ab = _a-_b;
-	Vector3D ac = _a-_c;
-
-    static bool never_checked = true;
-    static Vector3D normal = (ab).cross(ac).normalized();
 
-    if (never_checked) {
-        if (x_vector.norm() == 0 || y_vector.norm() == 0 || (std::abs(x_vector.dot(normal)) == 1 && std::abs(y_vector.dot(normal)) == 1)) {
+    if (x_vector.norm() == 0 || y_vector.norm() == 0 || (std::abs(x_vector.dot(normal)) == 1 && std::abs(y_vector.dot(normal)) == 1)) {
+        do {
             do {
-                do {
-                    x_vector = Vector3d::Random().normalized();
-
-                } while (x_vector.dot(normal) <= 0.3 && x_vector.dot(normal) > 0.7);
-                Launchable test_launch((_a + x_vector), -normal);
-                x_vector = (get_nearest_intersection_with_normal(test_launch).first - _a).normalized();
-                //std::cout << std::endl << "Normlized error " << x_vector.dot(normal);
-            } while (normal.dot(x_vector) != 0);
-            y_vector = x_vector.cross(normal).normalized();
-            proc->set_text_x(x_vector);
-            proc->set_text_y(y_vector);
-        }
-        else if (std::abs(x_vector.dot(normal)) != 0 && std::abs(y_vector.dot(normal)) != 0) {
-            Vector3D temp_vector;
-            if (std::abs(x_vector.dot(normal)) != 1) {
-                temp_vector = normal.cross(x_vector);
-                if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
-                temp_vector = normal.cross(y_vector);
-                if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
-            }
-            else {
-                temp_vector = normal.cross(y_vector);
-                if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
-                temp_vector = normal.cross(x_vector);
-                if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
-            }
-            proc->set_text_x(x_vector);
-            proc->set_text_y(y_vector);
-        }
-        else if (std::abs(x_vector.dot(normal)) == 0 && std::abs(y_vector.dot(normal)) != 0) {
-            Vector3D temp_vector = normal.cross(x_vector);
+                x_vector = Vector3d::Random().normalized();
+
+            } while (x_vector.dot(normal) <= 0.3 && x_vector.dot(normal) > 0.7);
+            x_vector = (x_vector - x_vector.dot(normal) * normal).normalized();
+            //std::cout << std::endl << "Normlized error " << x_vector.dot(normal);
+        } while (normal.dot(x_vector) != 0);
+        y_vector = x_vector.cross(normal).normalized();
+        proc->set_text_x(x_vector);
+        proc->set_text_y(y_vector);
+    }
+    else if (std::abs(x_vector.dot(normal)) != 0 && std::abs(y_vector.dot(normal)) != 0) {
+        Vector3D temp_vector;
+        if (std::abs(x_vector.dot(normal)) != 1) {
+            temp_vector = normal.cross(x_vector);
             if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
-            proc->set_text_y(y_vector);
+            temp_vector = normal.cross(y_vector);
+            if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
         }
-        else if (std::abs(y_vector.dot(normal)) == 0 && std::abs(x_vector.dot(normal)) != 0) {
-            Vector3D temp_vector = normal.cross(y_vector);
+        else {
+            temp_vector = normal.cross(y_vector);
             if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
-            proc->set_text_x(x_vector);
+            temp_vector = normal.cross(x_vector);
+            if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
         }
-        never_checked = false;
+        proc->set_text_x(x_vector);
+        proc->set_text_y(y_vector);
+    }
+    else if (std::abs(x_vector.dot(normal)) == 0 && std::abs(y_vector.dot(normal)) != 0) {
+        Vector3D temp_vector = normal.cross(x_vector);
+        if (temp_vector.dot(y_vector) >= 0) y_vector = temp_vector; else  y_vector = -temp_vector;
+        proc->set_text_y(y_vector);
     }
+    else if (std::abs(y_vector.dot(normal)) == 0 && std::abs(x_vector.dot(normal)) != 0) {
+        Vector3D temp_vector = normal.cross(y_vector);
+        if (temp_vector.dot(x_vector) >= 0) x_vector = temp_vector; else  x_vector = -temp_vector;
+        proc->set_text_x(x_vector);
+    }
+}
+
+/**
+ * \param inters_point : an intersection point where we seek the color
+ *
+ * This function determines the color at the given point of the surface
+ * It is related to the get_color(double, double) of the Texture where the
+ * two doubles represent coordinates for the texture map.
+ */
+Color Triangle::get_color_at(const Point3D& inters_point) const
+{
+    if (_texture->get_kind() == Texture::COLORED) return _texture->get_color(0,0);
+
+    Procedural * proc = static_cast<Procedural *>(_texture.get());
+    Vector3D x_vector = proc->get_text_x();
+    Vector3D y_vector = proc->get_text_y();
 
     double x_value = (inters_point - _a).dot(x_vector);
     double y_value = (inters_point - _a).dot(y_vector);
 
     return _texture->get_color(x_value, y_value);
 }
+
+/**
+ * \param box : filled with the box enclosing the triangle
+ *
+ * The box is slightly padded since it is flat when
+ * the triangle is aligned with an axis
+ */
+bool Triangle::get_bounding_box(BoundingBox& box) const
+{
+    static double epsilon = 1e-7;
+
+    box = BoundingBox();
+    box.extend(_a);
+    box.extend(_b);
+    box.extend(_c);
+    Vector3D padding = Vector3D::Constant(epsilon);
+    box = BoundingBox(box.get_min() - padding, box.get_max() + padding);
+    return true;
+}
@@ -8,6 +8,7 @@
  */
 
 #include "surface.hpp"
+#include "primitives.hpp"
 
 /**
  * \class Triangle
@@ -33,22 +34,30 @@ public:
 	 */
 	Triangle(double absorp, double reflect, double transp, Texture* tex,
             Point3D a, Point3D b, Point3D c, bool for_volume = false) :
-			Surface(absorp, reflect, transp, tex), _a(a), _b(b), _c(c), _for_volume(for_volume)
+			Surface(absorp, reflect, transp, tex), _a(a), _b(b), _c(c), _primitive(a, b, c),
+			_normal(_primitive.normal.normalized()), _for_volume(for_volume)
     {
         if ( std::abs((_b-_a).dot(_c-_a)) == 1 || std::abs((_a-_b).dot(_c-_b)) == 1 ) {
             std::cout << "CRITICAL FAILURE : One triangle isn't really a triangle (angle 0 or 180)" << std::endl;
             exit(EXIT_FAILURE);
         }
+        _type = TRIANGLE;
+        init_texture_frame();
     }
 
-	bool is_intersected_by(const Launchable&) const ; ///< Returns whether this triangle is intersected by a given launchable
-	Couple3D get_nearest_intersection_with_normal(const Launchable&) const ; ///< Returns the nearest intersection (point/normal) of the given launchable with this triangle
-	bool redirect_photon( const Couple3D&, Photon& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this triangle
+	const TrianglePrimitive& get_primitive() const { return _primitive ; } ///< Returns the geometry of this triangle for the kernels of the Scene
+	bool intersect(const Launchable&, double t_max, Hit&) const ; ///< Finds in one pass the nearest intersection of the given launchable with this triangle closer than t_max
+	bool redirect_photon( const Couple3D&, Photon&, Sampler& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this triangle
 	std::pair<Ray, Ray> divide_ray( const Couple3D&, const Ray& ) const; ///< Returns the division (reflected/refracted) of an incoming ray at the couple position
 	Color get_color_at(const Point3D&) const; ///< Returns the color at this point of the triangle
+	bool get_bounding_box(BoundingBox&) const ; ///< Fills the box enclosing this triangle
 
 private:
+	void init_texture_frame() ; ///< Fixes the frame of a procedural texture on the plane of the triangle
+
 	Point3D _a, _b, _c ; ///< Corners of the triangle
+	TrianglePrimitive _primitive ; ///< Edges and normal, computed once for the intersection kernel
+	Vector3D _normal ; ///< Unit normal of the triangle
 	bool _for_volume; ///< Whether this triangle is refracting (part of a volume ?)
 };
 
@@ -0,0 +1,315 @@
+/**
+ * \file triangle_mesh.cpp
+ * \brief Implementation of class TriangleMesh
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include "triangle_mesh.hpp"
+#include "primitives.hpp"
+#include <textures/colored.hpp>
+#include <textures/procedural.hpp>
+
+/**
+ * \brief Returns the geometry of a triangle of a mesh, its corners being read in the shared vertices
+ */
+static inline TrianglePrimitive get_triangle(const MeshData& data, unsigned int triangle)
+{
+	const unsigned int* corners = &data.indices[3*triangle];
+	return TrianglePrimitive(data.vertices[corners[0]], data.vertices[corners[1]], data.vertices[corners[2]]);
+}
+
+/**
+ * \brief Intersects the triangles reached in the leaves of the BVH of a mesh
+ *
+ * Keeps the nearest triangle found so far, with the barycentric
+ * coordinates of the intersection, and lowers the maximum distance
+ * of the traversal accordingly
+ */
+struct MeshNearestIntersector
+{
+	MeshNearestIntersector(const Launchable& l, const MeshData& data) :
+		_l(l), _data(data), _nearest(-1), _distance(0.0), _u(0.0), _v(0.0) {}
+
+	void operator()(unsigned int triangle, double& t_max)
+	{
+		if (get_triangle(_data, triangle).intersect(_l, t_max, _distance, _u, _v)) {
+			t_max = _distance;
+			_nearest = triangle;
+		}
+	}
+
+	const Launchable& _l ; ///< The launchable being traced
+	const MeshData& _data ; ///< The triangles of the mesh
+	int _nearest ; ///< Index of the nearest triangle so far, -1 if none
+	double _distance ; ///< Distance to this triangle
+	double _u, _v ; ///< Weights of the second and third corners of this triangle at the intersection
+};
+
+/**
+ * \brief Intersects the triangles reached in the leaves of the BVH of a mesh until one is hit
+ */
+struct MeshAnyIntersector
+{
+	MeshAnyIntersector(const Launchable& l, const MeshData& data) :
+		_l(l), _data(data), _found(false) {}
+
+	void operator()(unsigned int triangle, double& t_max)
+	{
+		double distance;
+		if (get_triangle(_data, triangle).intersect(_l, t_max, distance)) {
+			_found = true;
+			t_max = 0;
+		}
+	}
+
+	const Launchable& _l ; ///< The launchable being traced
+	const MeshData& _data ; ///< The triangles of the mesh
+	bool _found ; ///< Whether a triangle was hit
+};
+
+/**
+ * Exits if a triangle refers to a missing vertex, or if the
+ * normals are not one per vertex. The triangles are padded
+ * in the BVH since they are flat when aligned with an axis
+ */
+TriangleMesh::TriangleMesh(double absorp, double reflect, double transp, Texture* tex, MeshData& data) :
+	Surface(absorp, reflect, transp, tex)
+{
+	static double epsilon = 1e-7;
+
+	_data.vertices.swap(data.vertices);
+	_data.normals.swap(data.normals);
+	_data.indices.swap(data.indices);
+
+	if (_data.get_nb_triangles() == 0) {
+		std::cout << "CRITICAL FAILURE : One mesh has no triangle" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	if (!_data.normals.empty() && _data.normals.size() != _data.vertices.size()) {
+		std::cout << "CRITICAL FAILURE : One mesh doesn't have a normal per vertex" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	_data.indices.resize(3*_data.get_nb_triangles());
+	for (unsigned int i = 0; i < _data.indices.size(); i++)
+		if (_data.indices[i] >= _data.vertices.size()) {
+			std::cout << "CRITICAL FAILURE : One triangle of a mesh refers to a missing vertex" << std::endl;
+			exit(EXIT_FAILURE);
+		}
+
+	std::vector<BoundingBox> boxes(_data.get_nb_triangles());
+	Vector3D padding = Vector3D::Constant(epsilon);
+	for (unsigned int i = 0; i < boxes.size(); i++) {
+		BoundingBox box;
+		for (int k = 0; k < 3; k++) box.extend(_data.vertices[_data.indices[3*i + k]]);
+		boxes[i] = BoundingBox(box.get_min() - padding, box.get_max() + padding);
+	}
+	_bvh.build(boxes);
+
+	init_texture_frame();
+}
+
+/**
+ * \param l : the incoming launchable to test
+ * the collision with
+ * \param t_max : intersections farther than this distance are ignored
+ * \param hit : filled with the intersection if one is found
+ *
+ * This function returns whether the launchable direction
+ * will lead to a collision with a triangle before t_max.
+ * The normal given in the hit faces the start of the launchable,
+ * it is interpolated between the normals of the corners if the mesh has some
+ */
+bool TriangleMesh::intersect(const Launchable& l, double t_max, Hit& hit) const
+{
+    MeshNearestIntersector intersector(l, _data);
+    _bvh.traverse(l, t_max, intersector);
+    if (intersector._nearest < 0) return false;
+
+    TrianglePrimitive triangle = get_triangle(_data, intersector._nearest);
+    double distance = intersector._distance;
+	const Point3D& start = l.get_end_point() ;
+    Point3D intersection = start + distance * l.get_direction();
+    Vector3D normal = triangle.normal.normalized();
+    if (normal.dot(l.get_direction()) >= 0) normal = -normal;
+
+    if (!_data.normals.empty()) {
+        // Barycentric coordinates given by the kernel
+        const unsigned int* corners = &_data.indices[3*intersector._nearest];
+        double weight_b = intersector._u;
+        double weight_c = intersector._v;
+        double weight_a = 1.0 - weight_b - weight_c;
+        Vector3D smooth = weight_a * _data.normals[corners[0]] + weight_b * _data.normals[corners[1]]
+            + weight_c * _data.normals[corners[2]];
+        if (smooth.squaredNorm() > 0) {
+            smooth.normalize();
+            normal = (smooth.dot(normal) < 0) ? Vector3D(-smooth) : smooth;
+        }
+    }
+
+    hit.distance = distance;
+    hit.couple = Couple3D(intersection, normal);
+    hit.shape = this;
+	return true;
+}
+
+/**
+ * \param l : the launchable to test
+ * \param t_max : intersections farther than this distance are ignored
+ *
+ * The traversal stops at the first triangle found
+ */
+bool TriangleMesh::is_intersected_by(const Launchable& l, double t_max) const
+{
+    MeshAnyIntersector intersector(l, _data);
+    _bvh.traverse(l, t_max, intersector);
+    return intersector._found;
+}
+
+/**
+ * \param ph : the incoming photon to redirect
+ * \param sampler : the random generator of the photon
+ * \param couple : first parameter contains
+ * the intersection point, second contains the normal
+ * at this intersection
+ *
+ * This function determines if a photon will be
+ * aborbed, reflected or will pass through depending on the
+ * corresponding probabilities specified for this mesh
+ * It returns TRUE is the photon was redirected, and
+ * FALSE if the photon was absorbed
+ */
+bool TriangleMesh::redirect_photon( const Couple3D& couple, Photon& ph, Sampler& sampler ) const
+{
+    double number = sampler.next_double();
+
+    if (number < _reflection_prob) {
+        ph.set_end_point(couple.first);
+        ph.set_direction(ph.get_reflected(couple));
+        ph.leave_surface();
+
+        Color ph_c = ph.get_color() ;
+        Color shape_c = get_color_at(couple.first);
+        ph.set_color(
+            Color(
+                ph_c.get_r()*shape_c.get_r(),
+                ph_c.get_g()*shape_c.get_g(),
+                ph_c.get_b()*shape_c.get_b()
+            )
+        ) ;
+    }
+    else if (number < _reflection_prob + _transparency_prob) {
+        ph.set_end_point(couple.first);
+        ph.set_direction(ph.get_refracted(couple, 1.0));
+        ph.leave_surface();
+
+        Color ph_c = ph.get_color() ;
+        Color shape_c = get_color_at(couple.first);
+        ph.set_color(
+            Color(
+                ph_c.get_r()*shape_c.get_r(),
+                ph_c.get_g()*shape_c.get_g(),
+                ph_c.get_b()*shape_c.get_b()
+            )
+        ) ;
+    }
+    else {
+        return false;
+    }
+	return true;
+}
+
+/**
+ * \param ray : the incoming ray to divide
+ * \param couple : first parameter contains
+ * the intersection point, second contains the normal
+ * at this intersection
+ *
+ * This function divides a ray into a reflected and refracted ray
+ * only if the new ray can exist (probabilities not null)
+ */
+std::pair<Ray, Ray> TriangleMesh::divide_ray( const Couple3D& couple, const Ray& ray) const {
+    Point3D intersection_point = couple.first;
+
+    Ray reflected_ray(Point3D(0,0,0), Vector3D(0,0,0));
+    Ray refracted_ray(Point3D(0,0,0), Vector3D(0,0,0));
+
+    if (_reflection_prob != 0) {
+        reflected_ray = Ray(intersection_point, ray.get_reflected(couple));
+        reflected_ray.leave_surface();
+    }
+
+    if (_transparency_prob != 0) {
+        refracted_ray = Ray(intersection_point, ray.get_refracted(couple, 1.0));
+        refracted_ray.leave_surface();
+    }
+
+    return std::pair<Ray, Ray>(reflected_ray, refracted_ray);
+}
+
+/**
+ * \brief Returns a unit vector orthogonal to the given one
+ */
+static Vector3D get_orthogonal(const Vector3D& vector)
+{
+    Vector3D axis = (std::abs(vector[0]) < 0.9) ? Vector3D(1, 0, 0) : Vector3D(0, 1, 0);
+    return vector.cross(axis).normalized();
+}
+
+/**
+ * Fixes once for all the texture frame (text_x/text_y) of a procedural
+ * texture, along which it is projected on the mesh. Without any vector
+ * in the scene file, the texture is projected along the z axis ; with
+ * only one, the other is chosen orthogonal to it. Called by the
+ * constructor so that rendering only reads the frame, from any thread.
+ */
+void TriangleMesh::init_texture_frame()
+{
+    if (_texture->get_kind() != Texture::PROCEDURAL) return;
+    Procedural * proc = static_cast<Procedural *>(_texture.get());
+
+    Vector3D x_vector = proc->get_text_x();
+    Vector3D y_vector = proc->get_text_y();
+
+    if (x_vector.norm() == 0 && y_vector.norm() == 0) {
+        x_vector = Vector3D(1, 0, 0);
+        y_vector = Vector3D(0, 1, 0);
+    }
+    else if (x_vector.norm() == 0)
+        x_vector = get_orthogonal(y_vector);
+    else if (y_vector.norm() == 0)
+        y_vector = get_orthogonal(x_vector);
+
+    proc->set_text_x(x_vector);
+    proc->set_text_y(y_vector);
+}
+
+/**
+ * \param inters_point : an intersection point where we seek the color
+ *
+ * This function determines the color at the given point of the mesh,
+ * the procedural textures being projected from the smallest corner
+ * of the box of the mesh
+ */
+Color TriangleMesh::get_color_at(const Point3D& inters_point) const
+{
+    if (_texture->get_kind() == Texture::COLORED) return _texture->get_color(0,0);
+
+    Procedural * proc = static_cast<Procedural *>(_texture.get());
+    Vector3D from_origin = inters_point - _bvh.get_nodes()[0].box.get_min();
+
+    return _texture->get_color(from_origin.dot(proc->get_text_x()), from_origin.dot(proc->get_text_y()));
+}
+
+/**
+ * \param box : filled with the box enclosing the triangles
+ *
+ * It is the box of the root of the BVH of the mesh
+ */
+bool TriangleMesh::get_bounding_box(BoundingBox& box) const
+{
+    box = _bvh.get_nodes()[0].box;
+    return true;
+}
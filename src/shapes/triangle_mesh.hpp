@@ -0,0 +1,72 @@
+#ifndef TRIANGLE_MESH_HPP_
+#define TRIANGLE_MESH_HPP_
+
+/**
+ * \file triangle_mesh.hpp
+ * \brief Declaration of TriangleMesh class
+ * \author B.BORGOBELLO / T.FEIGLER
+ */
+
+#include <vector>
+#include "surface.hpp"
+#include "raytracing/bvh.hpp"
+
+/**
+ * \struct MeshData
+ * \brief Indexed triangles as read from a mesh file
+ *
+ * The corners of triangle i are the vertices indices[3i], indices[3i+1]
+ * and indices[3i+2]. The normals are either empty or one per vertex
+ */
+struct MeshData
+{
+	std::vector<Point3D> vertices ; ///< Positions of the vertices
+	std::vector<Vector3D> normals ; ///< Normal of each vertex, empty when the file gives none
+	std::vector<unsigned int> indices ; ///< Three vertex indices per triangle
+
+	unsigned int get_nb_triangles() const { return indices.size() / 3 ; } ///< Returns the number of triangles
+};
+
+/**
+ * \class TriangleMesh
+ * \brief Derived from Surface, representing many triangles sharing their vertices
+ *
+ * The triangles only store the indices of their corners in the shared
+ * vertex array, and have their own BVH : the scene sees the whole mesh
+ * as one shape. When the vertices have normals, they are interpolated
+ * over each triangle to shade it smoothly.
+ * Like a Triangle, the mesh reflects and lets Launchables through
+ */
+class TriangleMesh : public Surface
+{
+public:
+    /**
+	 * \brief Constructor
+	 *
+	 * Constructor of class TriangleMesh, which builds the BVH of the triangles
+	 *
+	 * \param absorp : absorption probability
+	 * \param reflect : reflection probability
+	 * \param transp : transparency probability
+	 * \param tex : pointer to the texture of this mesh
+	 * \param data : the triangles of the mesh, emptied by the constructor which takes their arrays
+	 */
+	TriangleMesh(double absorp, double reflect, double transp, Texture* tex, MeshData& data) ;
+
+	bool intersect(const Launchable&, double t_max, Hit&) const ; ///< Finds in one pass the nearest intersection of the given launchable with the triangles closer than t_max
+	bool is_intersected_by(const Launchable&, double t_max) const ; ///< Returns whether the given launchable meets a triangle closer than t_max, stopping at the first one
+	bool redirect_photon( const Couple3D&, Photon&, Sampler& ) const ; ///< Redirects (or not) a given photon depending on the probilities of this mesh
+	std::pair<Ray, Ray> divide_ray( const Couple3D&, const Ray& ) const; ///< Returns the division (reflected/refracted) of an incoming ray at the couple position
+	Color get_color_at(const Point3D&) const; ///< Returns the color at this point of the mesh
+	bool get_bounding_box(BoundingBox&) const ; ///< Fills the box enclosing all the triangles
+
+	const MeshData& get_data() const { return _data ; } ///< Returns the vertices and triangles of this mesh
+
+private:
+	void init_texture_frame() ; ///< Fixes the frame of a procedural texture, projected on the mesh
+
+	MeshData _data ; ///< The shared vertices, their normals and the triangles
+	BVH _bvh ; ///< Hierarchy over the triangles
+};
+
+#endif /* TRIANGLE_MESH_HPP_ */
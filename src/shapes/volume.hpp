@@ -38,7 +38,8 @@ public:
 
 	double get_refraction_prob() const { return _refraction_prob ; } ///< Returns the refraction probability
 
-	virtual Couple3D get_random_point_and_normal() const = 0 ; ///< Returns a random surface point and a random normal
+	virtual Couple3D get_random_point_and_normal(Sampler&) const = 0 ; ///< Returns a random surface point and a random normal
+	virtual Couple3D get_random_surface_point(Sampler&) const = 0 ; ///< Returns a random surface point and the outward normal at this point
 
 protected:
 	double _refraction_prob ; ///< The refraction probability
@@ -0,0 +1,219 @@
+#ifndef SIMD_HPP_
+#define SIMD_HPP_
+
+/**
+ * \file simd.hpp
+ * \author B.BORGOBELLO / T.FEIGLER
+ * \brief Declaration of classes Double4 and Float8
+ */
+
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * \class Double4
+ * \brief Four doubles computed together, one lane per ray of a RayPacket
+ *
+ * One AVX register when compiled with AVX (option PHOTON_MAPPING_AVX),
+ * two SSE2 registers otherwise, plain arrays without SSE2.
+ * Comparisons return masks whose lanes have all their bits set
+ * when true, to be combined with &, | and select().
+ * Every operation is the IEEE one of each lane : a kernel written in
+ * the same order as its scalar version gives the same results.
+ */
+class Double4
+{
+public:
+	Double4() {} ///< Uninitialised lanes
+
+#if defined(__AVX__)
+	Double4(double x) : _v(_mm256_set1_pd(x)) {} ///< All the lanes set to x
+	Double4(double x0, double x1, double x2, double x3) : _v(_mm256_setr_pd(x0, x1, x2, x3)) {} ///< Lanes set one by one
+
+	void store(double *out) const { _mm256_storeu_pd(out, _v) ; } ///< Writes the four lanes into out
+	int mask() const { return _mm256_movemask_pd(_v) ; } ///< Returns the sign bit of each lane, lane i as bit i
+
+	friend Double4 operator+(const Double4& a, const Double4& b) { return Double4(_mm256_add_pd(a._v, b._v)) ; }
+	friend Double4 operator-(const Double4& a, const Double4& b) { return Double4(_mm256_sub_pd(a._v, b._v)) ; }
+	friend Double4 operator*(const Double4& a, const Double4& b) { return Double4(_mm256_mul_pd(a._v, b._v)) ; }
+	friend Double4 operator/(const Double4& a, const Double4& b) { return Double4(_mm256_div_pd(a._v, b._v)) ; }
+	friend Double4 operator&(const Double4& a, const Double4& b) { return Double4(_mm256_and_pd(a._v, b._v)) ; }
+	friend Double4 operator|(const Double4& a, const Double4& b) { return Double4(_mm256_or_pd(a._v, b._v)) ; }
+	friend Double4 operator<(const Double4& a, const Double4& b) { return Double4(_mm256_cmp_pd(a._v, b._v, _CMP_LT_OQ)) ; }
+	friend Double4 operator<=(const Double4& a, const Double4& b) { return Double4(_mm256_cmp_pd(a._v, b._v, _CMP_LE_OQ)) ; }
+	friend Double4 operator>(const Double4& a, const Double4& b) { return Double4(_mm256_cmp_pd(a._v, b._v, _CMP_GT_OQ)) ; }
+	friend Double4 operator>=(const Double4& a, const Double4& b) { return Double4(_mm256_cmp_pd(a._v, b._v, _CMP_GE_OQ)) ; }
+	friend Double4 min(const Double4& a, const Double4& b) { return Double4(_mm256_min_pd(a._v, b._v)) ; }
+	friend Double4 max(const Double4& a, const Double4& b) { return Double4(_mm256_max_pd(a._v, b._v)) ; }
+	friend Double4 sqrt(const Double4& a) { return Double4(_mm256_sqrt_pd(a._v)) ; }
+	friend Double4 abs(const Double4& a) { return Double4(_mm256_andnot_pd(_mm256_set1_pd(-0.0), a._v)) ; }
+	friend Double4 select(const Double4& mask, const Double4& a, const Double4& b) { return Double4(_mm256_blendv_pd(b._v, a._v, mask._v)) ; } ///< a where mask is set, b elsewhere
+
+private:
+	Double4(__m256d v) : _v(v) {}
+	__m256d _v ; ///< The four lanes
+#elif defined(__SSE2__)
+	Double4(double x) : _lo(_mm_set1_pd(x)), _hi(_mm_set1_pd(x)) {} ///< All the lanes set to x
+	Double4(double x0, double x1, double x2, double x3) : _lo(_mm_setr_pd(x0, x1)), _hi(_mm_setr_pd(x2, x3)) {} ///< Lanes set one by one
+
+	void store(double *out) const { _mm_storeu_pd(out, _lo) ; _mm_storeu_pd(out + 2, _hi) ; } ///< Writes the four lanes into out
+	int mask() const { return _mm_movemask_pd(_lo) | (_mm_movemask_pd(_hi) << 2) ; } ///< Returns the sign bit of each lane, lane i as bit i
+
+	friend Double4 operator+(const Double4& a, const Double4& b) { return Double4(_mm_add_pd(a._lo, b._lo), _mm_add_pd(a._hi, b._hi)) ; }
+	friend Double4 operator-(const Double4& a, const Double4& b) { return Double4(_mm_sub_pd(a._lo, b._lo), _mm_sub_pd(a._hi, b._hi)) ; }
+	friend Double4 operator*(const Double4& a, const Double4& b) { return Double4(_mm_mul_pd(a._lo, b._lo), _mm_mul_pd(a._hi, b._hi)) ; }
+	friend Double4 operator/(const Double4& a, const Double4& b) { return Double4(_mm_div_pd(a._lo, b._lo), _mm_div_pd(a._hi, b._hi)) ; }
+	friend Double4 operator&(const Double4& a, const Double4& b) { return Double4(_mm_and_pd(a._lo, b._lo), _mm_and_pd(a._hi, b._hi)) ; }
+	friend Double4 operator|(const Double4& a, const Double4& b) { return Double4(_mm_or_pd(a._lo, b._lo), _mm_or_pd(a._hi, b._hi)) ; }
+	friend Double4 operator<(const Double4& a, const Double4& b) { return Double4(_mm_cmplt_pd(a._lo, b._lo), _mm_cmplt_pd(a._hi, b._hi)) ; }
+	friend Double4 operator<=(const Double4& a, const Double4& b) { return Double4(_mm_cmple_pd(a._lo, b._lo), _mm_cmple_pd(a._hi, b._hi)) ; }
+	friend Double4 operator>(const Double4& a, const Double4& b) { return Double4(_mm_cmpgt_pd(a._lo, b._lo), _mm_cmpgt_pd(a._hi, b._hi)) ; }
+	friend Double4 operator>=(const Double4& a, const Double4& b) { return Double4(_mm_cmpge_pd(a._lo, b._lo), _mm_cmpge_pd(a._hi, b._hi)) ; }
+	friend Double4 min(const Double4& a, const Double4& b) { return Double4(_mm_min_pd(a._lo, b._lo), _mm_min_pd(a._hi, b._hi)) ; }
+	friend Double4 max(const Double4& a, const Double4& b) { return Double4(_mm_max_pd(a._lo, b._lo), _mm_max_pd(a._hi, b._hi)) ; }
+	friend Double4 sqrt(const Double4& a) { return Double4(_mm_sqrt_pd(a._lo), _mm_sqrt_pd(a._hi)) ; }
+	friend Double4 abs(const Double4& a)
+	{
+		__m128d sign = _mm_set1_pd(-0.0) ;
+		return Double4(_mm_andnot_pd(sign, a._lo), _mm_andnot_pd(sign, a._hi)) ;
+	}
+	friend Double4 select(const Double4& mask, const Double4& a, const Double4& b) ///< a where mask is set, b elsewhere
+	{
+		return Double4(
+				_mm_or_pd(_mm_and_pd(mask._lo, a._lo), _mm_andnot_pd(mask._lo, b._lo)),
+				_mm_or_pd(_mm_and_pd(mask._hi, a._hi), _mm_andnot_pd(mask._hi, b._hi))
+			) ;
+	}
+
+private:
+	Double4(__m128d lo, __m128d hi) : _lo(lo), _hi(hi) {}
+	__m128d _lo ; ///< Lanes 0 and 1
+	__m128d _hi ; ///< Lanes 2 and 3
+#else
+	Double4(double x) { for (int i = 0; i < 4; i++) _v[i] = x ; } ///< All the lanes set to x
+	Double4(double x0, double x1, double x2, double x3) { _v[0] = x0 ; _v[1] = x1 ; _v[2] = x2 ; _v[3] = x3 ; } ///< Lanes set one by one
+
+	void store(double *out) const { for (int i = 0; i < 4; i++) out[i] = _v[i] ; } ///< Writes the four lanes into out
+	int mask() const ///< Returns the sign bit of each lane, lane i as bit i
+	{
+		int bits = 0 ;
+		for (int i = 0; i < 4; i++)
+			if (get_bits(_v[i]) >> 63) bits |= 1 << i ;
+		return bits ;
+	}
+
+	friend Double4 operator+(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = a._v[i] + b._v[i] ; return r ; }
+	friend Double4 operator-(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = a._v[i] - b._v[i] ; return r ; }
+	friend Double4 operator*(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = a._v[i] * b._v[i] ; return r ; }
+	friend Double4 operator/(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = a._v[i] / b._v[i] ; return r ; }
+	friend Double4 operator&(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = from_bits(get_bits(a._v[i]) & get_bits(b._v[i])) ; return r ; }
+	friend Double4 operator|(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = from_bits(get_bits(a._v[i]) | get_bits(b._v[i])) ; return r ; }
+	friend Double4 operator<(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = from_bool(a._v[i] < b._v[i]) ; return r ; }
+	friend Double4 operator<=(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = from_bool(a._v[i] <= b._v[i]) ; return r ; }
+	friend Double4 operator>(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = from_bool(a._v[i] > b._v[i]) ; return r ; }
+	friend Double4 operator>=(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = from_bool(a._v[i] >= b._v[i]) ; return r ; }
+	friend Double4 min(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = (a._v[i] < b._v[i]) ? a._v[i] : b._v[i] ; return r ; }
+	friend Double4 max(const Double4& a, const Double4& b) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = (a._v[i] > b._v[i]) ? a._v[i] : b._v[i] ; return r ; }
+	friend Double4 sqrt(const Double4& a) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = std::sqrt(a._v[i]) ; return r ; }
+	friend Double4 abs(const Double4& a) { Double4 r ; for (int i = 0; i < 4; i++) r._v[i] = std::abs(a._v[i]) ; return r ; }
+	friend Double4 select(const Double4& mask, const Double4& a, const Double4& b) ///< a where mask is set, b elsewhere
+	{
+		Double4 r ;
+		for (int i = 0; i < 4; i++) r._v[i] = (get_bits(mask._v[i]) >> 63) ? a._v[i] : b._v[i] ;
+		return r ;
+	}
+
+private:
+	static uint64_t get_bits(double x) { uint64_t bits ; std::memcpy(&bits, &x, sizeof(bits)) ; return bits ; }
+	static double from_bits(uint64_t bits) { double x ; std::memcpy(&x, &bits, sizeof(x)) ; return x ; }
+	static double from_bool(bool b) { return from_bits(b ? ~(uint64_t)0 : 0) ; }
+	double _v[4] ; ///< The four lanes
+#endif
+};
+
+/**
+ * \class Float8
+ * \brief Eight floats computed together, one lane per photon of a bucket of the PhotonMap
+ *
+ * One AVX register when compiled with AVX, two SSE registers otherwise,
+ * plain arrays without SSE2. Only the operations of the distance kernel.
+ */
+class Float8
+{
+public:
+	Float8() {} ///< Uninitialised lanes
+
+#if defined(__AVX__)
+	Float8(float x) : _v(_mm256_set1_ps(x)) {} ///< All the lanes set to x
+	static Float8 load(const float *in) { return Float8(_mm256_loadu_ps(in)) ; } ///< Reads eight consecutive floats
+
+	void store(float *out) const { _mm256_storeu_ps(out, _v) ; } ///< Writes the eight lanes into out
+	int mask() const { return _mm256_movemask_ps(_v) ; } ///< Returns the sign bit of each lane, lane i as bit i
+
+	friend Float8 operator+(const Float8& a, const Float8& b) { return Float8(_mm256_add_ps(a._v, b._v)) ; }
+	friend Float8 operator-(const Float8& a, const Float8& b) { return Float8(_mm256_sub_ps(a._v, b._v)) ; }
+	friend Float8 operator*(const Float8& a, const Float8& b) { return Float8(_mm256_mul_ps(a._v, b._v)) ; }
+	friend Float8 operator<(const Float8& a, const Float8& b) { return Float8(_mm256_cmp_ps(a._v, b._v, _CMP_LT_OQ)) ; }
+	friend Float8 operator<=(const Float8& a, const Float8& b) { return Float8(_mm256_cmp_ps(a._v, b._v, _CMP_LE_OQ)) ; }
+
+private:
+	Float8(__m256 v) : _v(v) {}
+	__m256 _v ; ///< The eight lanes
+#elif defined(__SSE2__)
+	Float8(float x) : _lo(_mm_set1_ps(x)), _hi(_mm_set1_ps(x)) {} ///< All the lanes set to x
+	static Float8 load(const float *in) { return Float8(_mm_loadu_ps(in), _mm_loadu_ps(in + 4)) ; } ///< Reads eight consecutive floats
+
+	void store(float *out) const { _mm_storeu_ps(out, _lo) ; _mm_storeu_ps(out + 4, _hi) ; } ///< Writes the eight lanes into out
+	int mask() const { return _mm_movemask_ps(_lo) | (_mm_movemask_ps(_hi) << 4) ; } ///< Returns the sign bit of each lane, lane i as bit i
+
+	friend Float8 operator+(const Float8& a, const Float8& b) { return Float8(_mm_add_ps(a._lo, b._lo), _mm_add_ps(a._hi, b._hi)) ; }
+	friend Float8 operator-(const Float8& a, const Float8& b) { return Float8(_mm_sub_ps(a._lo, b._lo), _mm_sub_ps(a._hi, b._hi)) ; }
+	friend Float8 operator*(const Float8& a, const Float8& b) { return Float8(_mm_mul_ps(a._lo, b._lo), _mm_mul_ps(a._hi, b._hi)) ; }
+	friend Float8 operator<(const Float8& a, const Float8& b) { return Float8(_mm_cmplt_ps(a._lo, b._lo), _mm_cmplt_ps(a._hi, b._hi)) ; }
+	friend Float8 operator<=(const Float8& a, const Float8& b) { return Float8(_mm_cmple_ps(a._lo, b._lo), _mm_cmple_ps(a._hi, b._hi)) ; }
+
+private:
+	Float8(__m128 lo, __m128 hi) : _lo(lo), _hi(hi) {}
+	__m128 _lo ; ///< Lanes 0 to 3
+	__m128 _hi ; ///< Lanes 4 to 7
+#else
+	Float8(float x) { for (int i = 0; i < 8; i++) _v[i] = x ; } ///< All the lanes set to x
+	static Float8 load(const float *in) { Float8 r ; for (int i = 0; i < 8; i++) r._v[i] = in[i] ; return r ; } ///< Reads eight consecutive floats
+
+	void store(float *out) const { for (int i = 0; i < 8; i++) out[i] = _v[i] ; } ///< Writes the eight lanes into out
+	int mask() const ///< Returns the sign bit of each lane, lane i as bit i
+	{
+		int bits = 0 ;
+		for (int i = 0; i < 8; i++)
+			if (std::signbit(_v[i])) bits |= 1 << i ;
+		return bits ;
+	}
+
+	friend Float8 operator+(const Float8& a, const Float8& b) { Float8 r ; for (int i = 0; i < 8; i++) r._v[i] = a._v[i] + b._v[i] ; return r ; }
+	friend Float8 operator-(const Float8& a, const Float8& b) { Float8 r ; for (int i = 0; i < 8; i++) r._v[i] = a._v[i] - b._v[i] ; return r ; }
+	friend Float8 operator*(const Float8& a, const Float8& b) { Float8 r ; for (int i = 0; i < 8; i++) r._v[i] = a._v[i] * b._v[i] ; return r ; }
+	friend Float8 operator<(const Float8& a, const Float8& b) { Float8 r ; for (int i = 0; i < 8; i++) r._v[i] = (a._v[i] < b._v[i]) ? -1.0f : 0.0f ; return r ; }
+	friend Float8 operator<=(const Float8& a, const Float8& b) { Float8 r ; for (int i = 0; i < 8; i++) r._v[i] = (a._v[i] <= b._v[i]) ? -1.0f : 0.0f ; return r ; }
+
+private:
+	float _v[8] ; ///< The eight lanes
+#endif
+};
+
+/**
+ * \brief Dot product of vectors given by their components, in the order of Eigen : a0*b0 + (a1*b1 + a2*b2)
+ */
+inline Double4 dot(const Double4& ax, const Double4& ay, const Double4& az,
+		const Double4& bx, const Double4& by, const Double4& bz)
+{
+	return ax * bx + (ay * by + az * bz) ;
+}
+
+#endif /* SIMD_HPP_ */
@@ -25,6 +25,8 @@ Color Bitmap::operator()(double x, double y) const
 
 	int pixel_x = std::abs(square_pos_x*_image.get_res_x());
 	int pixel_y = _image.get_res_y() - std::abs(square_pos_y*_image.get_res_y());
+	if (pixel_x >= _image.get_res_x()) pixel_x = _image.get_res_x() - 1 ;
+	if (pixel_y >= _image.get_res_y()) pixel_y = _image.get_res_y() - 1 ;
 
-    return *(_image.get_color(pixel_x, pixel_y).get());
+    return _image.get_color(pixel_x, pixel_y);
 }
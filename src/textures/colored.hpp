@@ -20,7 +20,7 @@ public:
 	 * \brief Constructor of Colored
 	 * \param c : color of the texture
 	 */
-	Colored(Color c) : _color(c) {}
+	Colored(Color c) : Texture(COLORED), _color(c) {}
 
 	Color get_color(double, double) const { return _color ; } ///< Returns the color of this texture
 
@@ -22,7 +22,7 @@ public:
  * \param text_x : a first orientation vector for the texture
  * \param text_y : a second orientation vector for the texture
  */
-    Procedural(Vector3D text_x, Vector3D text_y)
+    Procedural(Vector3D text_x, Vector3D text_y) : Texture(PROCEDURAL)
     {
         _text_x = (text_x.norm() == 0) ? text_x : text_x.normalized();
         _text_y = (text_y.norm() == 0) ? text_y : text_y.normalized();
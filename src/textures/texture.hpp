@@ -17,8 +17,17 @@
 class Texture
 {
 public:
-	Texture() {} ///< Constructor
+	/**
+	 * \brief Kind of the texture, so that the shapes tell a plain color from a pattern without RTTI
+	 */
+	enum Kind { COLORED, PROCEDURAL } ;
+
+	Texture(Kind kind) : _kind(kind) {} ///< Constructor
+	Kind get_kind() const { return _kind ; } ///< Returns whether this texture is a plain color or a pattern
 	virtual Color get_color(double, double) const = 0 ; ///< Returns the Color correponding to the given coordinates
+
+private:
+	Kind _kind ; ///< Whether this texture is a plain color or a pattern
 };
 
 #endif